@@ -0,0 +1,462 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#include "AssetCache.h"
+
+#include "Paths.h"
+#include "HAL/FileManager.h"
+#include "Misc/ConfigCacheIni.h"
+#include "Misc/Crc.h"
+#include "Misc/FileHelper.h"
+#include "Misc/SecureHash.h"
+
+#include "Runtime/Json/Public/Json.h"
+
+#include "AvatarApi.h"
+#include "AvatarSdkSample.h"
+#include "AvatarSdkStats.h"
+#include "ZipUtils.h"
+
+
+DEFINE_STAT(STAT_AvatarSdk_AssetCacheKB);
+DEFINE_STAT(STAT_AvatarSdk_AssetCacheDeduplicatedKB);
+DEFINE_STAT(STAT_AvatarSdk_AssetCacheEvictedKB);
+DEFINE_STAT(STAT_AvatarSdk_AssetCacheDamagedBlobs);
+
+
+namespace
+{
+	// a download not resumed for this long is abandoned
+	const double abandonedPartDays = 7.0;
+
+	FString ContentHash(const TArray<uint8> &content)
+	{
+		uint8 digest[20];
+		FSHA1::HashBuffer(content.GetData(), content.Num(), digest);
+		return BytesToHex(digest, sizeof(digest));
+	}
+}
+
+ItSeez3D::AssetCache & ItSeez3D::AssetCache::Get()
+{
+	static AssetCache cache;
+	return cache;
+}
+
+ItSeez3D::AssetCache::AssetCache()
+	: directory(EnsureDirectoryExists(FPaths::Combine(DownloadLocation(), TEXT("assets"))))
+{
+	int32 budgetMB = 512;
+	if (GConfig)
+		GConfig->GetInt(configSection, TEXT("AssetCacheBudgetMB"), budgetMB, GGameIni);
+	budget = int64(FMath::Max(1, budgetMB)) * 1024 * 1024;
+
+	LoadIndex();
+	DeleteOrphans();
+}
+
+bool ItSeez3D::AssetCache::Contains(const FString &name) const
+{
+	return names.Contains(name);
+}
+
+TArray<FString> ItSeez3D::AssetCache::NamesByRecentUse(const FString &prefix) const
+{
+	TArray<FString> result;
+	for (const auto &pair : names)
+	{
+		if (pair.Key.StartsWith(prefix))
+			result.Add(pair.Key);
+	}
+
+	result.Sort([this](const FString &a, const FString &b)
+	{
+		return blobs[names[a]].lastUsed > blobs[names[b]].lastUsed;
+	});
+	return result;
+}
+
+FString ItSeez3D::AssetCache::Find(const FString &name)
+{
+	const FString *hash = names.Find(name);
+	if (!hash)
+		return FString();
+
+	Touch(*hash);
+	return BlobPath(*hash);
+}
+
+void ItSeez3D::AssetCache::LoadAsync(const FString &name, const FOnFileLoaded &onLoaded)
+{
+	const FString path = Find(name);
+	if (path.IsEmpty())
+	{
+		onLoaded(FFileBytes());
+		return;
+	}
+
+	const FString hash = names[name];
+	LoadFileAsync(path, [this, hash, onLoaded](const FFileBytes &bytes)
+	{
+		OnBlobLoaded(hash, bytes.IsValid());
+		onLoaded(bytes);
+	}, VerifyCheck(hash));
+}
+
+void ItSeez3D::AssetCache::Put(const FString &name, const FFileBytes &content, const FOnAssetStored &onStored)
+{
+	TSharedRef<TArray<HashedAsset>, ESPMode::ThreadSafe> assets = MakeShareable(new TArray<HashedAsset>());
+	RunOnFileQueue([assets, name, content]()
+	{
+		assets->Add(HashAsset(name, content));
+	}, [this, assets, onStored]()
+	{
+		Store(*assets);
+		if (onStored)
+			onStored(true);
+	});
+}
+
+void ItSeez3D::AssetCache::PutArchive(const FString &prefix, const FFileBytes &archive, const FOnAssetStored &onStored)
+{
+	TSharedRef<TArray<HashedAsset>, ESPMode::ThreadSafe> assets = MakeShareable(new TArray<HashedAsset>());
+	TSharedRef<bool, ESPMode::ThreadSafe> bUnzipped = MakeShareable(new bool(false));
+	RunOnFileQueue([assets, bUnzipped, prefix, archive]()
+	{
+		*bUnzipped = UnzipBufferEntries(archive->GetData(), archive->Num(), [&assets, &prefix](const FString &entryName, TArray<uint8> &content)
+		{
+			assets->Add(HashAsset(prefix + entryName, ShareBytes(MoveTemp(content))));
+			return true;
+		});
+	}, [this, assets, bUnzipped, onStored]()
+	{
+		if (*bUnzipped)
+			Store(*assets);
+		if (onStored)
+			onStored(*bUnzipped);
+	});
+}
+
+ItSeez3D::AssetCache::HashedAsset ItSeez3D::AssetCache::HashAsset(const FString &name, const FFileBytes &content)
+{
+	HashedAsset asset;
+	asset.name = name;
+	asset.content = content;
+	asset.hash = ContentHash(*content);
+	asset.crc = FCrc::MemCrc32(content->GetData(), content->Num());
+	return asset;
+}
+
+void ItSeez3D::AssetCache::Store(const TArray<HashedAsset> &assets)
+{
+	TSet<FString> storedHashes;
+	for (const auto &asset : assets)
+	{
+		const FString &hash = asset.hash;
+		storedHashes.Add(hash);
+		if (const FString *previous = names.Find(asset.name))
+		{
+			if (*previous == hash)
+			{
+				Touch(hash);
+				continue;
+			}
+			Release(*previous);
+		}
+
+		const int32 size = asset.content->Num();
+		if (Blob *blob = blobs.Find(hash))
+		{
+			++blob->names;
+			INC_DWORD_STAT_BY(STAT_AvatarSdk_AssetCacheDeduplicatedKB, uint32(size / 1024));
+			UE_LOG(LogAvatarSdk, Log, TEXT("%s has the same content as a cached asset, %d bytes not stored"), *asset.name, size);
+		}
+		else
+		{
+			SaveFileAsync(BlobPath(hash), asset.content, [this, hash](bool bSaved)
+			{
+				if (!bSaved)
+					DropBlob(hash);
+			});
+
+			Blob newBlob;
+			newBlob.size = size;
+			newBlob.names = 1;
+			newBlob.crc = asset.crc;
+			newBlob.bHasCrc = true;
+			newBlob.bVerified = true;
+			blobs.Add(hash, newBlob);
+			totalSize += size;
+		}
+
+		names.Add(asset.name, hash);
+		Touch(hash);
+	}
+
+	Evict(storedHashes);
+	SaveIndex();
+}
+
+void ItSeez3D::AssetCache::Remove(const FString &name)
+{
+	FString hash;
+	if (!names.RemoveAndCopyValue(name, hash))
+		return;
+
+	Release(hash);
+	SaveIndex();
+}
+
+FString ItSeez3D::AssetCache::PartPath(const FString &name) const
+{
+	return FPaths::Combine(directory, FMD5::HashAnsiString(*name) + TEXT(".part"));
+}
+
+FString ItSeez3D::AssetCache::BlobPath(const FString &hash) const
+{
+	return FPaths::Combine(directory, hash + TEXT(".bin"));
+}
+
+void ItSeez3D::AssetCache::Touch(const FString &hash)
+{
+	Blob *blob = blobs.Find(hash);
+	if (!blob)
+		return;
+
+	blob->lastUsed = ++useClock;
+	useOrder.HeapPush(UseEntry{ blob->lastUsed, hash });
+
+	// every use adds an entry, drop the outdated ones before they outnumber the blobs
+	if (useOrder.Num() > 2 * blobs.Num() + 64)
+	{
+		useOrder.Reset();
+		for (const auto &pair : blobs)
+			useOrder.Add(UseEntry{ pair.Value.lastUsed, pair.Key });
+		useOrder.Heapify();
+	}
+}
+
+void ItSeez3D::AssetCache::Release(const FString &hash)
+{
+	Blob *blob = blobs.Find(hash);
+	if (!blob || --blob->names > 0)
+		return;
+
+	totalSize -= blob->size;
+	blobs.Remove(hash);
+	DeleteFileAsync(BlobPath(hash));
+}
+
+ItSeez3D::FFileCheck ItSeez3D::AssetCache::VerifyCheck(const FString &hash) const
+{
+	const Blob *blob = blobs.Find(hash);
+	if (!blob || blob->bVerified)
+		return FFileCheck();
+
+	// blobs indexed before the CRC was stored are checked against their name
+	const int64 size = blob->size;
+	const uint32 crc = blob->crc;
+	const bool bHasCrc = blob->bHasCrc;
+	return [hash, size, crc, bHasCrc](const TArray<uint8> &content)
+	{
+		if (content.Num() != size)
+			return false;
+		return bHasCrc ? FCrc::MemCrc32(content.GetData(), content.Num()) == crc : ContentHash(content) == hash;
+	};
+}
+
+void ItSeez3D::AssetCache::OnBlobLoaded(const FString &hash, bool bLoaded)
+{
+	if (bLoaded)
+	{
+		if (Blob *blob = blobs.Find(hash))
+			blob->bVerified = true;
+		return;
+	}
+
+	if (!blobs.Contains(hash))
+		return;
+
+	INC_DWORD_STAT(STAT_AvatarSdk_AssetCacheDamagedBlobs);
+	DeleteFileAsync(BlobPath(hash));
+	DropBlob(hash);
+}
+
+void ItSeez3D::AssetCache::DropBlob(const FString &hash)
+{
+	Blob removed;
+	if (!blobs.RemoveAndCopyValue(hash, removed))
+		return;
+
+	totalSize -= removed.size;
+	for (auto it = names.CreateIterator(); it; ++it)
+	{
+		if (it.Value() == hash)
+		{
+			UE_LOG(LogAvatarSdk, Warning, TEXT("Dropped %s, its blob is damaged or could not be stored"), *it.Key());
+			it.RemoveCurrent();
+		}
+	}
+	SaveIndex();
+}
+
+void ItSeez3D::AssetCache::Evict(const TSet<FString> &keepHashes)
+{
+	TArray<UseEntry> kept;
+	while (totalSize > budget && useOrder.Num() > 0)
+	{
+		UseEntry oldest;
+		useOrder.HeapPop(oldest, false);
+		const Blob *blob = blobs.Find(oldest.hash);
+		if (!blob || blob->lastUsed != oldest.lastUsed)
+			continue;
+		if (keepHashes.Contains(oldest.hash))
+		{
+			kept.Add(oldest);
+			continue;
+		}
+
+		const FString hash = oldest.hash;
+		const int64 size = blob->size;
+		for (auto it = names.CreateIterator(); it; ++it)
+		{
+			if (it.Value() == hash)
+				it.RemoveCurrent();
+		}
+		totalSize -= size;
+		blobs.Remove(hash);
+		DeleteFileAsync(BlobPath(hash));
+
+		INC_DWORD_STAT_BY(STAT_AvatarSdk_AssetCacheEvictedKB, uint32(size / 1024));
+		UE_LOG(LogAvatarSdk, Log, TEXT("Evicted %lld bytes, cache size %lld of %lld"), size, totalSize, budget);
+	}
+	for (const auto &entry : kept)
+		useOrder.HeapPush(entry);
+	SET_DWORD_STAT(STAT_AvatarSdk_AssetCacheKB, uint32(totalSize / 1024));
+}
+
+void ItSeez3D::AssetCache::LoadIndex()
+{
+	// writes interrupted by a crash never reached their final path
+	TArray<FString> leftovers;
+	IFileManager::Get().FindFiles(leftovers, *TemporaryFilePath(FPaths::Combine(directory, TEXT("*"))), true, false);
+	for (const auto &file : leftovers)
+		IFileManager::Get().Delete(*FPaths::Combine(directory, file), false, true, true);
+
+	FString text;
+	if (!FFileHelper::LoadFileToString(text, *FPaths::Combine(directory, TEXT("index.json")), FILEREAD_Silent))
+		return;
+
+	TSharedPtr<FJsonObject> json;
+	auto reader = TJsonReaderFactory<>::Create(text);
+	if (!FJsonSerializer::Deserialize(reader, json) || !json.IsValid())
+	{
+		UE_LOG(LogAvatarSdk, Warning, TEXT("Asset cache index is damaged, starting with empty cache"));
+		return;
+	}
+
+	const TSharedPtr<FJsonObject> *blobsJson = nullptr, *namesJson = nullptr;
+	if (!json->TryGetObjectField("blobs", blobsJson) || !json->TryGetObjectField("names", namesJson))
+		return;
+
+	for (const auto &field : (*blobsJson)->Values)
+	{
+		const auto object = field.Value->AsObject();
+		if (!object.IsValid())
+			continue;
+
+		Blob blob;
+		blob.size = int64(object->GetNumberField("size"));
+		blob.lastUsed = int64(object->GetNumberField("last_used"));
+		double crc = 0;
+		blob.bHasCrc = object->TryGetNumberField("crc", crc);
+		blob.crc = uint32(crc);
+		blobs.Add(field.Key, blob);
+		useOrder.Add(UseEntry{ blob.lastUsed, field.Key });
+		totalSize += blob.size;
+		useClock = FMath::Max(useClock, blob.lastUsed);
+	}
+
+	for (const auto &field : (*namesJson)->Values)
+	{
+		const FString hash = field.Value->AsString();
+		if (Blob *blob = blobs.Find(hash))
+		{
+			++blob->names;
+			names.Add(field.Key, hash);
+		}
+	}
+
+	useOrder.Heapify();
+	Evict(TSet<FString>());
+	UE_LOG(LogAvatarSdk, Log, TEXT("Asset cache has %d assets in %d blobs, %lld of %lld bytes"), names.Num(), blobs.Num(), totalSize, budget);
+}
+
+void ItSeez3D::AssetCache::DeleteOrphans()
+{
+	// a crash between a blob write and the index write leaves the blob unknown to the index
+	TArray<FString> files;
+	IFileManager::Get().FindFiles(files, *FPaths::Combine(directory, TEXT("*.bin")), true, false);
+	int32 deleted = 0;
+	for (const auto &file : files)
+	{
+		if (!blobs.Contains(FPaths::GetBaseFilename(file)))
+			deleted += IFileManager::Get().Delete(*FPaths::Combine(directory, file), false, true, true) ? 1 : 0;
+	}
+
+	// parts of cached assets were not removed after the download, the others may still be resumed
+	TSet<FString> cachedParts;
+	for (const auto &pair : names)
+		cachedParts.Add(FPaths::GetCleanFilename(PartPath(pair.Key)));
+
+	files.Reset();
+	IFileManager::Get().FindFiles(files, *FPaths::Combine(directory, TEXT("*.part")), true, false);
+	const FDateTime now = FDateTime::UtcNow();
+	for (const auto &file : files)
+	{
+		const FString path = FPaths::Combine(directory, file);
+		const FDateTime modified = IFileManager::Get().GetTimeStamp(*path);
+		if (cachedParts.Contains(file) || (now - modified).GetTotalDays() > abandonedPartDays)
+			deleted += IFileManager::Get().Delete(*path, false, true, true) ? 1 : 0;
+	}
+
+	if (deleted > 0)
+		UE_LOG(LogAvatarSdk, Log, TEXT("Deleted %d files unknown to the asset cache index"), deleted);
+}
+
+void ItSeez3D::AssetCache::SaveIndex() const
+{
+	TSharedRef<FJsonObject> blobsJson = MakeShareable(new FJsonObject());
+	for (const auto &pair : blobs)
+	{
+		TSharedRef<FJsonObject> object = MakeShareable(new FJsonObject());
+		object->SetNumberField("size", double(pair.Value.size));
+		object->SetNumberField("last_used", double(pair.Value.lastUsed));
+		if (pair.Value.bHasCrc)
+			object->SetNumberField("crc", double(pair.Value.crc));
+		blobsJson->SetObjectField(pair.Key, object);
+	}
+
+	TSharedRef<FJsonObject> namesJson = MakeShareable(new FJsonObject());
+	for (const auto &pair : names)
+		namesJson->SetStringField(pair.Key, pair.Value);
+
+	TSharedRef<FJsonObject> json = MakeShareable(new FJsonObject());
+	json->SetObjectField("blobs", blobsJson);
+	json->SetObjectField("names", namesJson);
+
+	FString text;
+	auto writer = TJsonWriterFactory<>::Create(&text);
+	FJsonSerializer::Serialize(json, writer);
+
+	const FTCHARToUTF8 utf8(*text);
+	TArray<uint8> bytes((const uint8 *)utf8.Get(), utf8.Length());
+	SaveFileAsync(FPaths::Combine(directory, TEXT("index.json")), MoveTemp(bytes));
+}
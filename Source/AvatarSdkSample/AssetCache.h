@@ -0,0 +1,117 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "AsyncFileIO.h"
+
+
+namespace ItSeez3D
+{
+	/// Called on the game thread, the asset is in the index if true.
+	typedef TFunction<void(bool)> FOnAssetStored;
+
+	/// Downloaded assets stored under DownloadLocation()/assets as blobs named by the SHA1 of their content, with an index
+	/// from asset names (e.g. "haircuts/<id>.png") to blobs. Identical content is stored once whatever its name.
+	/// When the blobs take more than AssetCacheBudgetMB (game config) the least recently used ones are evicted.
+	/// The index is read once, all queries are answered from memory. Content is hashed, archives are unzipped, and blobs
+	/// and the index are written on the async file queue. An asset can be found once Put reports it stored.
+	/// The index keeps a CRC32 of every blob, checked on the first load of the blob in a session. A damaged or missing
+	/// blob is dropped with all its names, so only the assets it held are downloaded again.
+	/// Blobs missing from the index and parts of finished or abandoned downloads are deleted at startup.
+	class AssetCache
+	{
+	public:
+		static AssetCache & Get();
+
+		bool Contains(const FString &name) const;
+
+		/// Cached asset names starting with the prefix, most recently used first.
+		TArray<FString> NamesByRecentUse(const FString &prefix) const;
+
+		/// Path of the blob, empty if the asset is not cached. The blob counts as used.
+		FString Find(const FString &name);
+
+		/// Null if the asset is not cached or its blob is damaged.
+		void LoadAsync(const FString &name, const FOnFileLoaded &onLoaded);
+
+		/// The buffer is written as it is, without a copy, it must not change afterwards.
+		void Put(const FString &name, const FFileBytes &content, const FOnAssetStored &onStored = FOnAssetStored());
+
+		/// Caches every entry of the zip archive as prefix + entry name, the archive itself is not stored.
+		/// Nothing is cached if the archive is damaged.
+		void PutArchive(const FString &prefix, const FFileBytes &archive, const FOnAssetStored &onStored = FOnAssetStored());
+
+		void Remove(const FString &name);
+
+		/// Where a download of the asset keeps the received part until it is complete.
+		FString PartPath(const FString &name) const;
+
+	private:
+		struct Blob
+		{
+			int64 size = 0;
+			int64 lastUsed = 0;
+			int32 names = 0;
+			uint32 crc = 0;
+			bool bHasCrc = false;
+			// checked or written in this session
+			bool bVerified = false;
+		};
+
+		// content hashed on the file queue, waiting to be indexed on the game thread
+		struct HashedAsset
+		{
+			FString name;
+			FFileBytes content;
+			FString hash;
+			uint32 crc = 0;
+		};
+
+		struct UseEntry
+		{
+			int64 lastUsed;
+			FString hash;
+
+			bool operator<(const UseEntry &other) const { return lastUsed < other.lastUsed; }
+		};
+
+		AssetCache();
+
+		static HashedAsset HashAsset(const FString &name, const FFileBytes &content);
+		void Store(const TArray<HashedAsset> &assets);
+
+		FString BlobPath(const FString &hash) const;
+		void Touch(const FString &hash);
+		void Release(const FString &hash);
+		FFileCheck VerifyCheck(const FString &hash) const;
+		void OnBlobLoaded(const FString &hash, bool bLoaded);
+		void DropBlob(const FString &hash);
+		void Evict(const TSet<FString> &keepHashes);
+
+		void LoadIndex();
+		void DeleteOrphans();
+		void SaveIndex() const;
+
+	private:
+		FString directory;
+		int64 budget = 0;
+		int64 totalSize = 0;
+		int64 useClock = 0;
+
+		TMap<FString, FString> names;
+		TMap<FString, Blob> blobs;
+
+		// min-heap of blob uses, entries older than the blob's lastUsed are skipped when evicting
+		TArray<UseEntry> useOrder;
+	};
+}
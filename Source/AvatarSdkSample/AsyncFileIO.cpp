@@ -0,0 +1,199 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#include "AsyncFileIO.h"
+
+#include "Async/Async.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/ScopeLock.h"
+
+#include "AvatarSdkSample.h"
+#include "AvatarSdkStats.h"
+
+
+DEFINE_STAT(STAT_AvatarSdk_BodyCopiedKB);
+
+
+namespace
+{
+	TAutoConsoleVariable<int32> CVarSyncFileIO(
+		TEXT("AvatarSdk.SyncFileIO"),
+		0,
+		TEXT("1 runs avatar asset file reads and writes on the calling thread, 0 on a worker thread"));
+
+	// one worker drains the queue, so operations keep their order
+	FCriticalSection queueLock;
+	TArray<TFunction<void()>> queue;
+	bool bWorkerRunning = false;
+
+	void Enqueue(const TFunction<void()> &operation)
+	{
+		if (ItSeez3D::IsFileIOSynchronous())
+		{
+			operation();
+			return;
+		}
+
+		FScopeLock scopeLock(&queueLock);
+		queue.Add(operation);
+		if (bWorkerRunning)
+			return;
+
+		bWorkerRunning = true;
+		Async<void>(EAsyncExecution::ThreadPool, []()
+		{
+			for (;;)
+			{
+				TArray<TFunction<void()>> batch;
+				{
+					FScopeLock scopeLock(&queueLock);
+					if (queue.Num() == 0)
+					{
+						bWorkerRunning = false;
+						return;
+					}
+					Swap(batch, queue);
+				}
+
+				for (const auto &next : batch)
+					next();
+			}
+		});
+	}
+
+	template <typename T>
+	void Deliver(const TFunction<void(T)> &callback, T value)
+	{
+		if (!callback)
+			return;
+
+		if (IsInGameThread())
+			callback(value);
+		else
+			AsyncTask(ENamedThreads::GameThread, [callback, value]() { callback(value); });
+	}
+}
+
+TFuture<bool> ItSeez3D::SaveFileAsync(const FString &path, TArray<uint8> &&content, const FOnFileSaved &onSaved)
+{
+	return SaveFileAsync(path, ShareBytes(MoveTemp(content)), onSaved);
+}
+
+TFuture<bool> ItSeez3D::SaveFileAsync(const FString &path, const FFileBytes &content, const FOnFileSaved &onSaved)
+{
+	check(content.IsValid());
+	TSharedRef<TPromise<bool>, ESPMode::ThreadSafe> promise = MakeShareable(new TPromise<bool>());
+	const FFileBytes bytes = content;
+	auto future = promise->GetFuture();
+	Enqueue([path, bytes, promise, onSaved]()
+	{
+		const FString tempPath = TemporaryFilePath(path);
+		const bool bSaved = FFileHelper::SaveArrayToFile(*bytes, *tempPath) && IFileManager::Get().Move(*path, *tempPath, true, true);
+		if (!bSaved)
+		{
+			UE_LOG(LogAvatarSdk, Warning, TEXT("Unable to write %s"), *path);
+			IFileManager::Get().Delete(*tempPath, false, true, true);
+		}
+		promise->SetValue(bSaved);
+		Deliver<bool>(onSaved, bSaved);
+	});
+	return future;
+}
+
+TFuture<bool> ItSeez3D::DeleteFileAsync(const FString &path)
+{
+	TSharedRef<TPromise<bool>, ESPMode::ThreadSafe> promise = MakeShareable(new TPromise<bool>());
+	auto future = promise->GetFuture();
+	Enqueue([path, promise]()
+	{
+		promise->SetValue(IFileManager::Get().Delete(*path, false, true, true));
+	});
+	return future;
+}
+
+TFuture<bool> ItSeez3D::AppendFileAsync(const FString &path, TArray<uint8> &&content)
+{
+	TSharedRef<TPromise<bool>, ESPMode::ThreadSafe> promise = MakeShareable(new TPromise<bool>());
+	TSharedRef<TArray<uint8>, ESPMode::ThreadSafe> bytes = MakeShareable(new TArray<uint8>(MoveTemp(content)));
+	auto future = promise->GetFuture();
+	Enqueue([path, bytes, promise]()
+	{
+		TUniquePtr<FArchive> writer(IFileManager::Get().CreateFileWriter(*path, FILEWRITE_Append));
+		if (writer)
+		{
+			writer->Serialize(bytes->GetData(), bytes->Num());
+			writer->Close();
+		}
+		const bool bAppended = writer && !writer->IsError();
+		if (!bAppended)
+			UE_LOG(LogAvatarSdk, Warning, TEXT("Unable to append to %s"), *path);
+		promise->SetValue(bAppended);
+	});
+	return future;
+}
+
+TFuture<ItSeez3D::FFileBytes> ItSeez3D::LoadFileAsync(const FString &path, const FOnFileLoaded &onLoaded, const FFileCheck &check)
+{
+	TSharedRef<TPromise<FFileBytes>, ESPMode::ThreadSafe> promise = MakeShareable(new TPromise<FFileBytes>());
+	auto future = promise->GetFuture();
+	Enqueue([path, promise, onLoaded, check]()
+	{
+		FFileBytes bytes = MakeShareable(new TArray<uint8>());
+		if (!FFileHelper::LoadFileToArray(*bytes, *path, FILEREAD_Silent))
+		{
+			if (IFileManager::Get().FileSize(*path) >= 0)
+				UE_LOG(LogAvatarSdk, Warning, TEXT("Unable to read %s"), *path);
+			bytes.Reset();
+		}
+		else if (check && !check(*bytes))
+		{
+			UE_LOG(LogAvatarSdk, Warning, TEXT("%s is damaged"), *path);
+			bytes.Reset();
+		}
+		promise->SetValue(bytes);
+		Deliver<const FFileBytes &>(onLoaded, bytes);
+	});
+	return future;
+}
+
+void ItSeez3D::RunOnFileQueue(const TFunction<void()> &work, const TFunction<void()> &onDone)
+{
+	Enqueue([work, onDone]()
+	{
+		work();
+		if (IsInGameThread())
+			onDone();
+		else
+			AsyncTask(ENamedThreads::GameThread, onDone);
+	});
+}
+
+FString ItSeez3D::TemporaryFilePath(const FString &path)
+{
+	return path + TEXT(".tmp");
+}
+
+bool ItSeez3D::IsFileIOSynchronous()
+{
+	return CVarSyncFileIO.GetValueOnAnyThread() != 0;
+}
+
+ItSeez3D::FFileBytes ItSeez3D::ShareBytes(TArray<uint8> &&content)
+{
+	return MakeShareable(new TArray<uint8>(MoveTemp(content)));
+}
+
+ItSeez3D::FFileBytes ItSeez3D::CopyBytes(const TArray<uint8> &content)
+{
+	INC_DWORD_STAT_BY(STAT_AvatarSdk_BodyCopiedKB, uint32(content.Num() / 1024));
+	return MakeShareable(new TArray<uint8>(content));
+}
@@ -0,0 +1,55 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/Future.h"
+
+
+namespace ItSeez3D
+{
+	/// Contents of a loaded file, null if it could not be read or does not exist.
+	typedef TSharedPtr<TArray<uint8>, ESPMode::ThreadSafe> FFileBytes;
+
+	typedef TFunction<void(bool)> FOnFileSaved;
+	typedef TFunction<void(const FFileBytes &)> FOnFileLoaded;
+
+	/// Runs on the worker thread with the loaded contents, false rejects them as damaged.
+	typedef TFunction<bool(const TArray<uint8> &)> FFileCheck;
+
+	/// File operations run one after another on a worker thread in the order they were issued, so a load sees
+	/// every save issued before it. Callbacks are called on the game thread. AvatarSdk.SyncFileIO 1 runs the
+	/// operations on the calling thread instead, to compare frame times.
+	/// Files are written to a .tmp file first and renamed, so a crash never leaves a truncated file at the path.
+	TFuture<bool> SaveFileAsync(const FString &path, TArray<uint8> &&content, const FOnFileSaved &onSaved = FOnFileSaved());
+	TFuture<bool> SaveFileAsync(const FString &path, const FFileBytes &content, const FOnFileSaved &onSaved = FOnFileSaved());
+	TFuture<bool> DeleteFileAsync(const FString &path);
+
+	/// Appends to the file in place, creating it if needed. Meant for files that are valid when cut short, e.g. partial downloads.
+	TFuture<bool> AppendFileAsync(const FString &path, TArray<uint8> &&content);
+
+	TFuture<FFileBytes> LoadFileAsync(const FString &path, const FOnFileLoaded &onLoaded = FOnFileLoaded(), const FFileCheck &check = FFileCheck());
+
+	/// Runs work that prepares file operations (e.g. hashing or unzipping the content) on the same worker, in order with
+	/// them. onDone is called on the game thread.
+	void RunOnFileQueue(const TFunction<void()> &work, const TFunction<void()> &onDone);
+
+	/// Where SaveFileAsync writes the content before renaming it, left behind if the process dies mid-write.
+	FString TemporaryFilePath(const FString &path);
+
+	bool IsFileIOSynchronous();
+
+	/// Asset bodies are passed between the download, cache and decode stages as FFileBytes. ShareBytes takes the buffer
+	/// over, CopyBytes is for buffers owned by someone else (e.g. an engine http response) and counts the copy in
+	/// "Asset body KB copied" of stat AvatarSdk.
+	FFileBytes ShareBytes(TArray<uint8> &&content);
+	FFileBytes CopyBytes(const TArray<uint8> &content);
+}
@@ -0,0 +1,401 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#include "AuthSession.h"
+
+#include "Paths.h"
+#include "Containers/Ticker.h"
+#include "Misc/AES.h"
+
+#include "Runtime/Json/Public/Json.h"
+
+#if PLATFORM_WINDOWS
+#include "Windows/AllowWindowsPlatformTypes.h"
+#include <wincrypt.h>
+#include "Windows/HideWindowsPlatformTypes.h"
+#endif
+
+#include "AvatarSdkSample.h"
+#include "HttpRecordReplay.h"
+
+
+namespace
+{
+	const uint32 storageMagic = 0x41565341;  // "AVSA"
+
+	// token is considered expired this long before the server says so
+	const double expirySafetySeconds = 30;
+
+	// background refresh starts this long before the expiry, or halfway through the lifetime of a shorter token
+	const double refreshAheadSeconds = 300;
+
+	// used if the server does not report token lifetime
+	const double defaultTokenLifetimeSeconds = 3600;
+
+	void Dispatch(const ItSeez3D::FRequestDispatcher &dispatcher, const TSharedRef<IHttpRequest> &request, const ItSeez3D::FResponseHandler &handler)
+	{
+		if (dispatcher)
+		{
+			dispatcher(request, handler);
+			return;
+		}
+
+		request->OnProcessRequestComplete().BindLambda([handler](FHttpRequestPtr, FHttpResponsePtr response, bool bWasSuccessful)
+		{
+			handler(response, bWasSuccessful);
+		});
+		request->ProcessRequest();
+	}
+
+	// a completed request can't be sent again, the retry is a new one with the same url, headers and body
+	TSharedRef<IHttpRequest> CopyRequest(IHttpRequest &request)
+	{
+		auto copy = ItSeez3D::CreateHttpRequest();
+		copy->SetURL(request.GetURL());
+		copy->SetVerb(request.GetVerb());
+		for (const auto &line : request.GetAllHeaders())
+		{
+			FString name, value;
+			if (line.Split(TEXT(":"), &name, &value))
+				copy->SetHeader(name.Trim().TrimTrailing(), value.Trim().TrimTrailing());
+		}
+		copy->SetContent(request.GetContent());
+		return copy;
+	}
+
+	// seals the data with the credential store of the platform, false if there is none
+	bool ProtectWithPlatformStore(TArray<uint8> &data)
+	{
+#if PLATFORM_WINDOWS
+		DATA_BLOB input = { DWORD(data.Num()), data.GetData() };
+		DATA_BLOB output = { 0, nullptr };
+		if (!CryptProtectData(&input, nullptr, nullptr, nullptr, nullptr, CRYPTPROTECT_UI_FORBIDDEN, &output))
+			return false;
+		data = TArray<uint8>(output.pbData, int32(output.cbData));
+		LocalFree(output.pbData);
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	// false if the data was not sealed by ProtectWithPlatformStore for this user
+	bool UnprotectWithPlatformStore(TArray<uint8> &data)
+	{
+#if PLATFORM_WINDOWS
+		DATA_BLOB input = { DWORD(data.Num()), data.GetData() };
+		DATA_BLOB output = { 0, nullptr };
+		if (!CryptUnprotectData(&input, nullptr, nullptr, nullptr, nullptr, CRYPTPROTECT_UI_FORBIDDEN, &output))
+			return false;
+		data = TArray<uint8>(output.pbData, int32(output.cbData));
+		LocalFree(output.pbData);
+		return true;
+#else
+		return false;
+#endif
+	}
+}
+
+ItSeez3D::AuthSession & ItSeez3D::AuthSession::Get()
+{
+	static AuthSession session;
+	return session;
+}
+
+ItSeez3D::AuthSession::AuthSession()
+{
+	Load();
+}
+
+bool ItSeez3D::AuthSession::HasValidToken() const
+{
+	return !credentials.accessToken.IsEmpty() && (expiresAt - FDateTime::UtcNow()).GetTotalSeconds() > expirySafetySeconds;
+}
+
+bool ItSeez3D::AuthSession::IsReady() const
+{
+	return HasValidToken() && !credentials.playerUID.IsEmpty();
+}
+
+void ItSeez3D::AuthSession::Acquire(const FOnCredentialsReady &callback)
+{
+	if (!bLoaded)
+	{
+		waiters.Add(callback);
+		return;
+	}
+
+	if (IsReady())
+	{
+		UE_LOG(LogAvatarSdk, Log, TEXT("Using cached credentials, token expires at %s"), *expiresAt.ToString());
+		callback.ExecuteIfBound(true, credentials);
+		return;
+	}
+
+	waiters.Add(callback);
+	if (!bRequestInFlight)
+	{
+		bRequestInFlight = true;
+		Continue();
+	}
+}
+
+void ItSeez3D::AuthSession::Reacquire(const FString &rejectedAuthorization, const FOnCredentialsReady &callback)
+{
+	// requests sent with the old token keep failing for a while after a new one arrived, they just get the new one
+	if (!credentials.accessToken.IsEmpty() && AuthorizationHeader(credentials) == rejectedAuthorization)
+		InvalidateToken();
+	Acquire(callback);
+}
+
+void ItSeez3D::AuthSession::InvalidateToken()
+{
+	if (credentials.accessToken.IsEmpty())
+		return;
+
+	UE_LOG(LogAvatarSdk, Warning, TEXT("Access token was rejected, it will be requested again"));
+	credentials.accessToken.Empty();
+	Save();
+}
+
+void ItSeez3D::AuthSession::Continue()
+{
+	if (!HasValidToken())
+		Authorize();
+	else if (credentials.playerUID.IsEmpty())
+		RegisterPlayer();
+	else
+		Complete(true);
+}
+
+void ItSeez3D::AuthSession::Authorize()
+{
+	MultipartRequestBody form;
+	AuthorizationForm(form);
+
+	auto request = PostRequest(Url("o", "token"), form, Credentials());
+	request->OnProcessRequestComplete().BindLambda([this](FHttpRequestPtr, FHttpResponsePtr response, bool bWasSuccessful)
+	{
+		const auto authResponse = HandleJsonResponse(response, bWasSuccessful);
+		if (!authResponse.IsValid())
+		{
+			Complete(false);
+			return;
+		}
+
+		credentials.tokenType = authResponse->GetStringField("token_type");
+		credentials.accessToken = authResponse->GetStringField("access_token");
+
+		double lifetime = defaultTokenLifetimeSeconds;
+		authResponse->TryGetNumberField("expires_in", lifetime);
+		expiresAt = FDateTime::UtcNow() + FTimespan::FromSeconds(lifetime);
+		UE_LOG(LogAvatarSdk, Log, TEXT("Got new access token, expires in %.0f s"), lifetime);
+
+		Continue();
+	});
+	request->ProcessRequest();
+}
+
+void ItSeez3D::AuthSession::RegisterPlayer()
+{
+	MultipartRequestBody form;
+	form.TextField("comment", "test_unreal_player");
+	form.Footer();
+
+	auto request = PostRequest(Url("players"), form, credentials);
+	request->OnProcessRequestComplete().BindLambda([this](FHttpRequestPtr, FHttpResponsePtr response, bool bWasSuccessful)
+	{
+		const auto playerResponse = HandleJsonResponse(response, bWasSuccessful);
+		if (!playerResponse.IsValid())
+		{
+			if (response.IsValid() && response->GetResponseCode() == EHttpResponseCodes::Denied)
+				InvalidateToken();
+			Complete(false);
+			return;
+		}
+
+		credentials.playerUID = playerResponse->GetStringField("code");
+		UE_LOG(LogAvatarSdk, Log, TEXT("Registered player %s"), *credentials.playerUID);
+		Continue();
+	});
+	request->ProcessRequest();
+}
+
+void ItSeez3D::AuthSession::Complete(bool bSucceeded)
+{
+	bRequestInFlight = false;
+	if (bSucceeded)
+	{
+		Save();
+		ScheduleRefresh();
+	}
+
+	const auto callbacks = waiters;
+	waiters.Empty();
+	for (const auto &callback : callbacks)
+		callback.ExecuteIfBound(bSucceeded, credentials);
+}
+
+void ItSeez3D::AuthSession::ScheduleRefresh()
+{
+	if (refreshHandle.IsValid())
+		FTicker::GetCoreTicker().RemoveTicker(refreshHandle);
+
+	const double remaining = (expiresAt - FDateTime::UtcNow()).GetTotalSeconds();
+	const float delay = float(FMath::Max(1.0, FMath::Max(remaining - refreshAheadSeconds, remaining / 2)));
+	refreshHandle = FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &AuthSession::OnRefreshTimer), delay);
+}
+
+bool ItSeez3D::AuthSession::OnRefreshTimer(float deltaTime)
+{
+	refreshHandle.Reset();
+	if (bRequestInFlight)
+		return false;
+
+	// the old token stays in use until the new one arrives
+	UE_LOG(LogAvatarSdk, Log, TEXT("Refreshing access token in background"));
+	bRequestInFlight = true;
+	Authorize();
+	return false;
+}
+
+FString ItSeez3D::AuthSession::StoragePath() const
+{
+	return FPaths::Combine(DownloadLocation(), TEXT("credentials.bin"));
+}
+
+void ItSeez3D::AuthSession::Save() const
+{
+	TSharedRef<FJsonObject> json = MakeShareable(new FJsonObject());
+	json->SetStringField("token_type", credentials.tokenType);
+	json->SetStringField("access_token", credentials.accessToken);
+	json->SetStringField("expires_at", FString::Printf(TEXT("%lld"), expiresAt.GetTicks()));
+	json->SetStringField("player_uid", credentials.playerUID);
+
+	FString text;
+	auto writer = TJsonWriterFactory<>::Create(&text);
+	FJsonSerializer::Serialize(json, writer);
+
+	// [magic][payload size][utf-8 json], padded to the AES block size, sealed by the platform if it can.
+	// The AES key is derivable on this device (see CredentialsStorageKey), it only keeps the token out of plain sight.
+	const FTCHARToUTF8 utf8(*text);
+	const uint32 payloadSize = utf8.Length();
+	const uint32 headerSize = 2 * sizeof(uint32);
+	TArray<uint8> data;
+	data.SetNumZeroed(Align(headerSize + payloadSize, FAES::AESBlockSize));
+	FMemory::Memcpy(data.GetData(), &storageMagic, sizeof(uint32));
+	FMemory::Memcpy(data.GetData() + sizeof(uint32), &payloadSize, sizeof(uint32));
+	FMemory::Memcpy(data.GetData() + headerSize, utf8.Get(), payloadSize);
+
+	if (!ProtectWithPlatformStore(data))
+		FAES::EncryptData(data.GetData(), data.Num(), TCHAR_TO_ANSI(*CredentialsStorageKey()));
+
+	const FString path = StoragePath();
+	SaveFileAsync(path, MoveTemp(data), [path](bool bSaved)
+	{
+		if (!bSaved)
+			UE_LOG(LogAvatarSdk, Warning, TEXT("Unable to store credentials to %s"), *path);
+	});
+}
+
+void ItSeez3D::AuthSession::Load()
+{
+	// queued before any save, so the file is read as the previous session left it
+	LoadFileAsync(StoragePath(), [this](const FFileBytes &stored)
+	{
+		OnLoaded(stored);
+		bLoaded = true;
+		if (HasValidToken())
+			ScheduleRefresh();
+
+		if (waiters.Num() > 0 && !bRequestInFlight)
+		{
+			bRequestInFlight = true;
+			Continue();
+		}
+	});
+}
+
+void ItSeez3D::AuthSession::OnLoaded(const FFileBytes &stored)
+{
+	if (!stored.IsValid())
+		return;
+
+	TArray<uint8> data = *stored;
+	const uint32 headerSize = 2 * sizeof(uint32);
+	if (!UnprotectWithPlatformStore(data))
+	{
+		if (data.Num() < int32(headerSize) || data.Num() % FAES::AESBlockSize != 0)
+		{
+			UE_LOG(LogAvatarSdk, Warning, TEXT("Stored credentials are damaged, ignoring them"));
+			return;
+		}
+		FAES::DecryptData(data.GetData(), data.Num(), TCHAR_TO_ANSI(*CredentialsStorageKey()));
+	}
+
+	if (data.Num() < int32(headerSize))
+	{
+		UE_LOG(LogAvatarSdk, Warning, TEXT("Stored credentials are damaged, ignoring them"));
+		return;
+	}
+
+	uint32 magic, payloadSize;
+	FMemory::Memcpy(&magic, data.GetData(), sizeof(uint32));
+	FMemory::Memcpy(&payloadSize, data.GetData() + sizeof(uint32), sizeof(uint32));
+	if (magic != storageMagic || headerSize + payloadSize > uint32(data.Num()))
+	{
+		// different application keys or user, credentials are not ours
+		UE_LOG(LogAvatarSdk, Warning, TEXT("Stored credentials can't be decrypted, ignoring them"));
+		return;
+	}
+
+	const FUTF8ToTCHAR text((const ANSICHAR *)data.GetData() + headerSize, payloadSize);
+	TSharedPtr<FJsonObject> json;
+	auto reader = TJsonReaderFactory<>::Create(FString(text.Length(), text.Get()));
+	if (!FJsonSerializer::Deserialize(reader, json) || !json.IsValid())
+		return;
+
+	credentials.tokenType = json->GetStringField("token_type");
+	credentials.accessToken = json->GetStringField("access_token");
+	credentials.playerUID = json->GetStringField("player_uid");
+
+	expiresAt = FDateTime(FCString::Atoi64(*json->GetStringField("expires_at")));
+
+	UE_LOG(LogAvatarSdk, Log, TEXT("Loaded stored credentials of player %s, token valid: %d"), *credentials.playerUID, int(HasValidToken()));
+}
+
+void ItSeez3D::SendAuthorized(const TSharedRef<IHttpRequest> &request, const FResponseHandler &handler, const FRequestDispatcher &dispatcher)
+{
+	const FString authorization = request->GetHeader(TEXT("Authorization"));
+	TWeakPtr<IHttpRequest> weakRequest = request;
+	Dispatch(dispatcher, request, [weakRequest, authorization, handler, dispatcher](FHttpResponsePtr response, bool bWasSuccessful)
+	{
+		const auto rejected = weakRequest.Pin();
+		if (!rejected.IsValid() || !response.IsValid() || response->GetResponseCode() != EHttpResponseCodes::Denied)
+		{
+			handler(response, bWasSuccessful);
+			return;
+		}
+
+		UE_LOG(LogAvatarSdk, Warning, TEXT("Access token was rejected for %s, sending the request again with a new one"), *rejected->GetURL());
+		const auto retry = CopyRequest(*rejected);
+		AuthSession::Get().Reacquire(authorization, FOnCredentialsReady::CreateLambda([retry, handler, dispatcher, response, bWasSuccessful](bool bSucceeded, const Credentials &credentials)
+		{
+			if (!bSucceeded)
+			{
+				handler(response, bWasSuccessful);
+				return;
+			}
+
+			SetCommonHeaders(retry, credentials);
+			Dispatch(dispatcher, retry, handler);
+		}));
+	});
+}
@@ -0,0 +1,85 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "AsyncFileIO.h"
+#include "AvatarApi.h"
+
+
+namespace ItSeez3D
+{
+	/// Called with bSucceeded == false if the token or the player could not be obtained.
+	DECLARE_DELEGATE_TwoParams(FOnCredentialsReady, bool /*bSucceeded*/, const Credentials &);
+
+	/// Sends the request and calls the handler when it completes, lets the owner queue or throttle requests.
+	typedef TFunction<void(FHttpResponsePtr, bool)> FResponseHandler;
+	typedef TFunction<void(const TSharedRef<IHttpRequest> &, const FResponseHandler &)> FRequestDispatcher;
+
+	/// Process-wide OAuth token and player UID.
+	/// Credentials are stored in the download location and reused by all actors and across sessions, the token is
+	/// refreshed in the background shortly before it expires. Requests sent with SendAuthorized get a new token when
+	/// the server rejects theirs. The file is read and written on the async file queue, Acquire waits for the read.
+	/// On Windows the file is sealed with DPAPI, readable only by the same user on the same machine. On other platforms
+	/// it is AES-scrambled with a key derivable from the application binary and the login (see CredentialsStorageKey):
+	/// that is obfuscation, not protection.
+	class AuthSession
+	{
+	public:
+		static AuthSession & Get();
+
+		/// Calls back immediately if valid credentials are cached, otherwise after o/token and/or players requests.
+		void Acquire(const FOnCredentialsReady &callback);
+
+		/// Latest credentials, requests take them when they are built, so a new token reaches all of them.
+		const Credentials & GetCredentials() const { return credentials; }
+
+		/// The server rejected a request sent with this Authorization header. Forgets the token unless it was replaced
+		/// in the meantime, then calls back like Acquire. The player UID is kept.
+		void Reacquire(const FString &rejectedAuthorization, const FOnCredentialsReady &callback);
+
+	private:
+		AuthSession();
+
+		void InvalidateToken();
+
+		bool HasValidToken() const;
+		bool IsReady() const;
+
+		void Continue();
+		void Authorize();
+		void RegisterPlayer();
+		void Complete(bool bSucceeded);
+
+		void ScheduleRefresh();
+		bool OnRefreshTimer(float deltaTime);
+
+		void Load();
+		void OnLoaded(const FFileBytes &stored);
+		void Save() const;
+		FString StoragePath() const;
+
+	private:
+		Credentials credentials;
+		FDateTime expiresAt;
+
+		// Acquire waits for the stored credentials
+		bool bLoaded = false;
+		bool bRequestInFlight = false;
+		TArray<FOnCredentialsReady> waiters;
+		FDelegateHandle refreshHandle;
+	};
+
+	/// Sends the request through the dispatcher, right away if there is none. If the server rejects the access token,
+	/// a new one is acquired and a copy of the request is sent once more with it. The handler gets the last response.
+	void SendAuthorized(const TSharedRef<IHttpRequest> &request, const FResponseHandler &handler, const FRequestDispatcher &dispatcher = FRequestDispatcher());
+}
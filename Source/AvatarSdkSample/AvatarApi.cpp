@@ -0,0 +1,421 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#include "AvatarApi.h"
+
+#include <map>
+
+#if PLATFORM_IOS
+	#import <Foundation/Foundation.h>
+#endif
+
+#include "Paths.h"
+#include "PlatformFilemanager.h"
+#include "Misc/ConfigCacheIni.h"
+#include "Misc/ScopeLock.h"
+#include "Misc/SecureHash.h"
+
+#include "Runtime/Json/Public/Json.h"
+
+#include "AvatarSdkSample.h"
+#include "AvatarSdkStats.h"
+#include "HttpCache.h"
+#include "HttpRecordReplay.h"
+#include "Utf8JsonReader.h"
+
+
+DECLARE_CYCLE_STAT(TEXT("Json decoding"), STAT_AvatarSdk_JsonDecode, STATGROUP_AvatarSdk);
+
+DEFINE_STAT(STAT_AvatarSdk_DirectoryChecks);
+
+
+namespace
+{
+	const char *clientId = "";
+	const char *clientSecret = "";
+
+	void ReadAvatarField(ItSeez3D::Utf8JsonReader &reader, ItSeez3D::AvatarData &avatar)
+	{
+		if (reader.KeyIs("code"))
+			reader.ReadString(avatar.code);
+		else if (reader.KeyIs("status"))
+			reader.ReadString(avatar.status);
+		else if (reader.KeyIs("mesh"))
+			reader.ReadString(avatar.mesh);
+		else if (reader.KeyIs("texture"))
+			reader.ReadString(avatar.texture);
+		else if (reader.KeyIs("haircuts"))
+			reader.ReadString(avatar.haircuts);
+		else if (reader.KeyIs("progress"))
+			reader.ReadInt(avatar.progress);
+	}
+
+	void ReadHaircutField(ItSeez3D::Utf8JsonReader &reader, ItSeez3D::HaircutData &haircut)
+	{
+		if (reader.KeyIs("identity"))
+			reader.ReadString(haircut.id);
+		else if (reader.KeyIs("mesh"))
+			reader.ReadString(haircut.mesh);
+		else if (reader.KeyIs("texture"))
+			reader.ReadString(haircut.texture);
+		else if (reader.KeyIs("pointcloud"))
+			reader.ReadString(haircut.pointCloud);
+	}
+}
+
+ItSeez3D::AvatarData::AvatarData(const FJsonObject &json)
+{
+	code = json.GetStringField("code");
+	status = json.GetStringField("status");
+	json.TryGetStringField("mesh", mesh);
+	json.TryGetStringField("texture", texture);
+	json.TryGetStringField("haircuts", haircuts);
+	progress = json.GetIntegerField("progress");
+}
+
+ItSeez3D::HaircutData::HaircutData(const FJsonObject &json)
+{
+	id = json.GetStringField("identity");
+	json.TryGetStringField("mesh", mesh);
+	json.TryGetStringField("texture", texture);
+	json.TryGetStringField("pointcloud", pointCloud);
+}
+
+ItSeez3D::MultipartRequestBody::MultipartRequestBody()
+{
+	// generate multipart form boundary
+	const auto guid = FGuid::NewGuid().ToString();
+	boundary = std::string(TCHAR_TO_UTF8(*guid));
+	separator = "\r\n--" + boundary + "\r\n";
+}
+
+void ItSeez3D::MultipartRequestBody::TextField(const std::string &name, const std::string &value)
+{
+	Part part;
+	part.header = separator;
+	part.header += "Content-Disposition: form-data; name=\"" + name + "\"\r\n";
+	part.header += "Content-Type: text/plain; encoding=utf-8\r\n\r\n";
+	part.text = value;
+	parts.Add(part);
+}
+
+void ItSeez3D::MultipartRequestBody::FileField(const std::string &name, const std::string &filename, const char *data, size_t size)
+{
+	Part part;
+	part.header = separator;
+	part.header += "Content-Disposition: file; name=\"" + name + "\"; ";
+	part.header += "filename=\"" + filename + "\"\r\n";
+	part.header += "Content-Type: application/octet-stream\r\n\r\n";
+	part.data = data;
+	part.size = size;
+	parts.Add(part);
+}
+
+void ItSeez3D::MultipartRequestBody::Footer()
+{
+	footer = "\r\n--" + boundary + "--\r\n";
+}
+
+int64 ItSeez3D::MultipartRequestBody::GetContentLength() const
+{
+	int64 length = footer.size();
+	for (const auto &part : parts)
+		length += part.header.size() + part.text.size() + part.size;
+	return length;
+}
+
+TArray<uint8> ItSeez3D::MultipartRequestBody::GetBody() const
+{
+	TArray<uint8> content;
+	content.Reserve(GetContentLength());
+	for (const auto &part : parts)
+	{
+		content.Append((const uint8 *)part.header.data(), part.header.size());
+		content.Append((const uint8 *)part.text.data(), part.text.size());
+		if (part.size > 0)
+			content.Append((const uint8 *)part.data, part.size);
+	}
+	content.Append((const uint8 *)footer.data(), footer.size());
+	return content;
+}
+
+FString ItSeez3D::MultipartRequestBody::GetContentType() const
+{
+	return "multipart/form-data; boundary=\"" + FString(UTF8_TO_TCHAR(boundary.c_str())) + "\"";
+}
+
+void ItSeez3D::MultipartRequestBody::LogBody() const
+{
+	UE_LOG(LogAvatarSdk, Log, TEXT("content %s, %lld bytes"), *GetContentType(), GetContentLength());
+	for (const auto &part : parts)
+	{
+		const FString header = UTF8_TO_TCHAR(part.header.c_str());
+		UE_LOG(LogAvatarSdk, Log, TEXT("%s<%d bytes>"), *header.TrimTrailing(), int32(part.text.size() + part.size));
+	}
+}
+
+FString ItSeez3D::GetRootUrl()
+{
+	static const FString rootUrl = []()
+	{
+		FString url;
+		if (GConfig)
+			GConfig->GetString(configSection, TEXT("RootUrl"), url, GGameIni);
+		if (url.IsEmpty())
+			url = TEXT("https://avatar-api.itseez3d.com");
+		url.RemoveFromEnd(TEXT("/"));
+		return url;
+	}();
+	return rootUrl;
+}
+
+bool ItSeez3D::IsHttpCodeGood(int code)
+{
+	return code >= 200 && code < 400;
+}
+
+FString ItSeez3D::AuthorizationHeader(const Credentials &credentials)
+{
+	return credentials.tokenType + " " + credentials.accessToken;
+}
+
+void ItSeez3D::SetCommonHeaders(const TSharedRef<IHttpRequest> &req, const Credentials &credentials)
+{
+	req->SetHeader("User-Agent", "X-UnrealEngineAvatarPlugin-Agent");
+	if (!credentials.accessToken.IsEmpty())
+		req->SetHeader("Authorization", AuthorizationHeader(credentials));
+	if (!credentials.playerUID.IsEmpty())
+		req->SetHeader("X-PlayerUID", credentials.playerUID);
+}
+
+TSharedRef<IHttpRequest> ItSeez3D::GetRequest(const FString &url, const Credentials &credentials)
+{
+	UE_LOG(LogAvatarSdk, Log, TEXT("Url %s"), *url);
+	auto req = CreateHttpRequest();
+	req->SetURL(url);
+	req->SetVerb("GET");
+	SetCommonHeaders(req, credentials);
+	HttpCache::Get().AddValidators(req);
+	return req;
+}
+
+TSharedRef<IHttpRequest> ItSeez3D::PostRequest(const FString &url, MultipartRequestBody &form, const Credentials &credentials)
+{
+	UE_LOG(LogAvatarSdk, Log, TEXT("Url %s"), *url);
+	auto req = CreateHttpRequest();
+	req->SetURL(url);
+	req->SetVerb("POST");
+	form.LogBody();
+	req->SetContent(form.GetBody());
+	req->SetHeader("Content-Type", form.GetContentType());
+	SetCommonHeaders(req, credentials);
+	return req;
+}
+
+void ItSeez3D::AuthorizationForm(MultipartRequestBody &form)
+{
+	form.TextField("grant_type", "client_credentials");
+	form.TextField("client_id", clientId);
+	form.TextField("client_secret", clientSecret);
+	form.Footer();
+}
+
+FString ItSeez3D::ClientId()
+{
+	return UTF8_TO_TCHAR(clientId);
+}
+
+FString ItSeez3D::CredentialsStorageKey()
+{
+	const FString seed = FString(UTF8_TO_TCHAR(clientId)) + FString(UTF8_TO_TCHAR(clientSecret)) + FPlatformMisc::GetLoginId();
+	return FMD5::HashAnsiString(*seed);
+}
+
+bool ItSeez3D::HandleResponse(FHttpResponsePtr response, bool bWasSuccessful)
+{
+	if (!response.IsValid())
+	{
+		UE_LOG(LogAvatarSdk, Error, TEXT("Request failed, no response"));
+		return false;
+	}
+
+	// content is converted to a string only for the error log, successful bodies may be large
+	const auto code = response->GetResponseCode();
+	UE_LOG(LogAvatarSdk, Log, TEXT("Request completed. good: %d, Code: %d, %d bytes"), int(bWasSuccessful), code, response->GetContent().Num());
+
+	if (!bWasSuccessful || !IsHttpCodeGood(code))
+	{
+		UE_LOG(LogAvatarSdk, Error, TEXT("Request was not successful, Content: %s"), *response->GetContentAsString());
+		return false;
+	}
+
+	return true;
+}
+
+TSharedPtr<FJsonObject> ItSeez3D::HandleJsonResponse(FHttpResponsePtr response, bool bWasSuccessful)
+{
+	TSharedPtr<FJsonObject> data;
+
+	if (!HandleResponse(response, bWasSuccessful))
+		return data;
+
+	auto jsonReader = TJsonReaderFactory<>::Create(response->GetContentAsString());
+	if (FJsonSerializer::Deserialize(jsonReader, data))
+		return data;
+	else
+	{
+		UE_LOG(LogAvatarSdk, Error, TEXT("Json parsing failed!"));
+		return TSharedPtr<FJsonObject>();
+	}
+}
+
+bool ItSeez3D::ReadAvatar(const TArray<uint8> &content, AvatarData &avatar)
+{
+	SCOPE_CYCLE_COUNTER(STAT_AvatarSdk_JsonDecode);
+
+	Utf8JsonReader reader(content.GetData(), content.Num());
+	const bool bParsed = reader.ReadObject([&avatar](Utf8JsonReader &field) { ReadAvatarField(field, avatar); });
+	return bParsed && !avatar.code.IsEmpty();
+}
+
+bool ItSeez3D::ReadHaircuts(const TArray<uint8> &content, TArray<TSharedPtr<HaircutData>> &haircuts)
+{
+	SCOPE_CYCLE_COUNTER(STAT_AvatarSdk_JsonDecode);
+
+	Utf8JsonReader reader(content.GetData(), content.Num());
+	return reader.ReadArray([&haircuts](Utf8JsonReader &element)
+	{
+		TSharedPtr<HaircutData> haircut = MakeShareable(new HaircutData());
+		if (element.ReadObject([&haircut](Utf8JsonReader &field) { ReadHaircutField(field, *haircut); }) && !haircut->id.IsEmpty())
+			haircuts.Add(haircut);
+	});
+}
+
+TSharedPtr<ItSeez3D::AvatarData> ItSeez3D::HandleAvatarResponse(FHttpResponsePtr response, bool bWasSuccessful)
+{
+	if (!HandleResponse(response, bWasSuccessful))
+		return TSharedPtr<AvatarData>();
+
+	TSharedPtr<AvatarData> avatar = MakeShareable(new AvatarData());
+	if (!ReadAvatar(response->GetContent(), *avatar))
+	{
+		UE_LOG(LogAvatarSdk, Error, TEXT("Avatar json parsing failed!"));
+		return TSharedPtr<AvatarData>();
+	}
+	return avatar;
+}
+
+bool ItSeez3D::HandleHaircutsResponse(FHttpResponsePtr response, bool bWasSuccessful, TArray<TSharedPtr<HaircutData>> &haircuts)
+{
+	if (!HandleResponse(response, bWasSuccessful))
+		return false;
+
+	if (!ReadHaircuts(response->GetContent(), haircuts))
+	{
+		UE_LOG(LogAvatarSdk, Error, TEXT("Haircuts json parsing failed!"));
+		return false;
+	}
+	return true;
+}
+
+const TArray<uint8> & ItSeez3D::HandleDataResponse(FHttpResponsePtr response, bool bWasSuccessful, bool &bIsOk)
+{
+	static const TArray<uint8> empty;
+	if (!response.IsValid())
+	{
+		UE_LOG(LogAvatarSdk, Error, TEXT("Data request failed, no response"));
+		bIsOk = false;
+		return empty;
+	}
+
+	const auto code = response->GetResponseCode();
+	UE_LOG(LogAvatarSdk, Log, TEXT("Request completed. good: %d, Code: %d"), int(bWasSuccessful), code);
+
+	bIsOk = true;
+	if (!bWasSuccessful || !IsHttpCodeGood(code))
+	{
+		UE_LOG(LogAvatarSdk, Error, TEXT("Data request was not successful"));
+		bIsOk = false;
+	}
+
+	return response->GetContent();
+}
+
+FString ItSeez3D::EnsureDirectoryExists(const FString &dir)
+{
+	// directories are never removed while running, so each one is checked once per session
+	static FCriticalSection lock;
+	static TSet<FString> knownDirectories;
+	{
+		FScopeLock scopeLock(&lock);
+		if (knownDirectories.Contains(dir))
+			return dir;
+	}
+
+	INC_DWORD_STAT(STAT_AvatarSdk_DirectoryChecks);
+#if PLATFORM_IOS
+	const char *locationUTF8 = TCHAR_TO_UTF8(*dir);
+	NSString *dataPath = [NSString stringWithUTF8String : locationUTF8];
+
+	if (![[NSFileManager defaultManager] fileExistsAtPath:dataPath])
+		[[NSFileManager defaultManager] createDirectoryAtPath:dataPath withIntermediateDirectories : YES attributes : nil error : nil];
+#else
+	auto &platformFile = FPlatformFileManager::Get().GetPlatformFile();
+	if (!platformFile.DirectoryExists(*dir))
+		platformFile.CreateDirectory(*dir);
+#endif
+
+	FScopeLock scopeLock(&lock);
+	knownDirectories.Add(dir);
+	return dir;
+}
+
+FString ItSeez3D::DownloadLocation()
+{
+	static const FString location = []()
+	{
+#if PLATFORM_IOS
+		NSArray *paths = NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES);
+		NSString *documentsDirectory = [paths objectAtIndex : 0];
+		const char *docPath = [documentsDirectory UTF8String];
+		return FString(UTF8_TO_TCHAR(docPath));
+#else
+		return FPaths::GamePersistentDownloadDir();
+#endif
+	}();
+	return location;
+}
+
+FString ItSeez3D::DownloadLocation(const FString &avatarCode)
+{
+	const auto location = FPaths::Combine(DownloadLocation(), avatarCode);
+	return EnsureDirectoryExists(location);
+}
+
+FString ItSeez3D::HaircutDownloadLocation()
+{
+	const auto location = FPaths::Combine(DownloadLocation(), TEXT("haircuts"));
+	return EnsureDirectoryExists(location);
+}
+
+FString ItSeez3D::HaircutAssetName(HaircutFile file, const FString &haircutId)
+{
+	static const std::map<HaircutFile, FString> ext =
+	{
+		{ HaircutFile::MESH, TEXT("ply") },
+		{ HaircutFile::TEXTURE, TEXT("png") },
+	};
+	return FString::Printf(TEXT("haircuts/%s.%s"), *haircutId, *ext.at(file));
+}
+
+FString ItSeez3D::AvatarAssetName(const FString &avatarCode, const FString &fileName)
+{
+	return FString::Printf(TEXT("avatars/%s/%s"), *avatarCode, *fileName);
+}
@@ -0,0 +1,150 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#pragma once
+
+#include <string>
+
+#include "CoreMinimal.h"
+
+#include "Runtime/Online/HTTP/Public/Http.h"
+
+
+class FJsonObject;
+class FJsonValue;
+
+namespace ItSeez3D
+{
+	struct AvatarData
+	{
+		AvatarData() = default;
+		AvatarData(const FJsonObject &json);
+
+		FString code, status;
+		FString mesh, texture, haircuts;
+		int progress = 0;
+	};
+
+	struct HaircutData
+	{
+		HaircutData() = default;
+		HaircutData(const FJsonObject &json);
+
+		FString id;
+		FString mesh, texture, pointCloud;
+	};
+
+	// authentication data shared by all requests of a session
+	struct Credentials
+	{
+		FString tokenType, accessToken, playerUID;
+	};
+
+	// multipart form utils
+	// Fields are collected first and written into one buffer of the exact size in GetBody().
+	// The body is never streamed: IHttpRequest of UE 4.16 takes the content only as an array, so a photo is in memory
+	// while it uploads.
+	class MultipartRequestBody
+	{
+	public:
+		MultipartRequestBody();
+
+		void TextField(const std::string &name, const std::string &value);
+
+		/// Data is not copied, it must stay valid until GetBody() is called.
+		void FileField(const std::string &name, const std::string &filename, const char *data, size_t size);
+		void Footer();
+
+		int64 GetContentLength() const;
+		TArray<uint8> GetBody() const;
+		FString GetContentType() const;
+
+		/// Logs part headers and sizes, never the payload.
+		void LogBody() const;
+
+	private:
+		struct Part
+		{
+			std::string header;
+			std::string text;
+			const char *data = nullptr;
+			size_t size = 0;
+		};
+
+		std::string boundary, separator;
+		TArray<Part> parts;
+		std::string footer;
+	};
+
+	/// RootUrl in the game config, the public avatar service by default.
+	FString GetRootUrl();
+
+	inline FString Join(const FString &token)
+	{
+		return token;
+	}
+
+	template<typename... Args>
+	FString Join(const FString &token, Args... tokens)
+	{
+		return token + "/" + Join(std::forward<Args>(tokens)...);
+	}
+
+	template<typename... Args>
+	FString Url(Args... tokens)
+	{
+		return Join(GetRootUrl(), std::forward<Args>(tokens)...) + "/";
+	}
+
+	bool IsHttpCodeGood(int code);
+
+	FString AuthorizationHeader(const Credentials &credentials);
+	void SetCommonHeaders(const TSharedRef<IHttpRequest> &req, const Credentials &credentials);
+	TSharedRef<IHttpRequest> GetRequest(const FString &url, const Credentials &credentials);
+	TSharedRef<IHttpRequest> PostRequest(const FString &url, MultipartRequestBody &form, const Credentials &credentials);
+
+	// form for the o/token request, filled with client id and secret of the application
+	void AuthorizationForm(MultipartRequestBody &form);
+
+	// client id of the application, avatars on the server belong to it
+	FString ClientId();
+
+	// 32-character key scrambling credentials stored on this device, derived from the application keys and the user login.
+	// Anyone with the application binary and the login can derive it, so it is obfuscation, not protection.
+	FString CredentialsStorageKey();
+
+	bool HandleResponse(FHttpResponsePtr response, bool bWasSuccessful);
+	TSharedPtr<FJsonObject> HandleJsonResponse(FHttpResponsePtr response, bool bWasSuccessful);
+	/// Returns the response content itself, valid while the response is alive. Bind it by reference to avoid copying large payloads.
+	const TArray<uint8> & HandleDataResponse(FHttpResponsePtr response, bool bWasSuccessful, bool &bIsOk);
+
+	/// Avatar and haircut json is decoded straight from the utf-8 response bytes, without a DOM.
+	bool ReadAvatar(const TArray<uint8> &content, AvatarData &avatar);
+	bool ReadHaircuts(const TArray<uint8> &content, TArray<TSharedPtr<HaircutData>> &haircuts);
+	TSharedPtr<AvatarData> HandleAvatarResponse(FHttpResponsePtr response, bool bWasSuccessful);
+	bool HandleHaircutsResponse(FHttpResponsePtr response, bool bWasSuccessful, TArray<TSharedPtr<HaircutData>> &haircuts);
+
+	FString EnsureDirectoryExists(const FString &dir);
+	FString DownloadLocation();
+	FString DownloadLocation(const FString &avatarCode);
+
+	// haircut meshes and textures are shared by all avatars
+	enum class HaircutFile
+	{
+		MESH,
+		TEXTURE,
+	};
+
+	FString HaircutDownloadLocation();
+
+	// names of the downloaded assets in the AssetCache, the haircut mesh name matches its entry in the haircut archive
+	FString HaircutAssetName(HaircutFile file, const FString &haircutId);
+	FString AvatarAssetName(const FString &avatarCode, const FString &fileName);
+}
@@ -0,0 +1,365 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#include "AvatarBatchGenerator.h"
+
+#include "Paths.h"
+#include "Containers/Ticker.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/ConfigCacheIni.h"
+
+#include "AssetCache.h"
+#include "AuthSession.h"
+#include "AvatarSdkSample.h"
+#include "AvatarStatusPoller.h"
+#include "HttpCache.h"
+#include "HttpRecordReplay.h"
+#include "PhotoPreprocessor.h"
+
+
+namespace
+{
+	int32 MaxConnectionsPerServer()
+	{
+		int32 maxConnections = 16;
+		if (GConfig)
+			GConfig->GetInt(TEXT("HTTP"), TEXT("HttpMaxConnectionsPerServer"), maxConnections, GEngineIni);
+		return FMath::Max(1, maxConnections);
+	}
+}
+
+struct ItSeez3D::AvatarBatchGenerator::Job
+{
+	BatchAvatarResult result;
+	TSharedPtr<AvatarData> avatar;
+	bool meshDownloaded = false, textureDownloaded = false;
+	bool finished = false;
+};
+
+ItSeez3D::AvatarBatchGenerator::AvatarBatchGenerator(int32 maxConcurrentRequests)
+	: maxConcurrentRequests(maxConcurrentRequests > 0 ? maxConcurrentRequests : MaxConnectionsPerServer())
+{
+}
+
+void ItSeez3D::AvatarBatchGenerator::Generate(const TArray<FString> &photoUrls, const FOnBatchAvatarCompleted &onAvatarCompleted, const FSimpleDelegate &onBatchCompleted)
+{
+	this->onAvatarCompleted = onAvatarCompleted;
+	this->onBatchCompleted = onBatchCompleted;
+
+	jobs.Empty(photoUrls.Num());
+	for (int32 i = 0; i < photoUrls.Num(); ++i)
+	{
+		TSharedRef<Job> job = MakeShareable(new Job());
+		job->result.index = i;
+		job->result.photoUrl = photoUrls[i];
+		jobs.Add(job);
+	}
+	jobsRemaining = jobs.Num();
+	batchStartTime = FPlatformTime::Seconds();
+
+	if (jobs.Num() == 0)
+	{
+		UE_LOG(LogAvatarSdk, Warning, TEXT("No photos in the batch"));
+		this->onBatchCompleted.ExecuteIfBound();
+		return;
+	}
+
+	UE_LOG(LogAvatarSdk, Log, TEXT("Generating %d avatars, at most %d concurrent requests"), jobs.Num(), maxConcurrentRequests);
+
+	AuthSession::Get().Acquire(FOnCredentialsReady::CreateSP(this, &AvatarBatchGenerator::OnCredentialsReady));
+}
+
+void ItSeez3D::AvatarBatchGenerator::Submit(const TSharedRef<IHttpRequest> &request, const ResponseHandler &handler)
+{
+	TWeakPtr<AvatarBatchGenerator> weakThis = AsShared();
+	request->OnProcessRequestComplete().BindLambda([weakThis, handler](FHttpRequestPtr, FHttpResponsePtr response, bool bWasSuccessful)
+	{
+		if (auto generator = weakThis.Pin())
+			generator->OnRequestCompleted(response, bWasSuccessful, handler);
+	});
+
+	pendingRequests.Emplace(request, handler);
+	PumpQueue();
+}
+
+ItSeez3D::FRequestDispatcher ItSeez3D::AvatarBatchGenerator::Dispatcher()
+{
+	// authorized requests and ranges of the downloads go through the same queue as the other requests of the batch
+	TWeakPtr<AvatarBatchGenerator> weakThis = AsShared();
+	return [weakThis](const TSharedRef<IHttpRequest> &request, const FRangeResponseHandler &handler)
+	{
+		if (auto generator = weakThis.Pin())
+			generator->Submit(request, handler);
+		else
+			handler(FHttpResponsePtr(), false);
+	};
+}
+
+void ItSeez3D::AvatarBatchGenerator::OnRequestCompleted(FHttpResponsePtr response, bool bWasSuccessful, ResponseHandler handler)
+{
+	--requestsInFlight;
+	handler(response, bWasSuccessful);
+	PumpQueue();
+}
+
+void ItSeez3D::AvatarBatchGenerator::PumpQueue()
+{
+	while (requestsInFlight < maxConcurrentRequests && pendingRequests.Num() > 0)
+	{
+		auto request = pendingRequests[0].Key;
+		pendingRequests.RemoveAt(0, 1, false);
+		++requestsInFlight;
+		request->ProcessRequest();
+	}
+}
+
+void ItSeez3D::AvatarBatchGenerator::OnCredentialsReady(bool bSucceeded, const Credentials &sessionCredentials)
+{
+	if (!bSucceeded)
+	{
+		UE_LOG(LogAvatarSdk, Error, TEXT("Authorization failed, batch aborted"));
+		for (auto &job : jobs)
+			FinishJob(job, false);
+		return;
+	}
+
+	StartJobs();
+}
+
+void ItSeez3D::AvatarBatchGenerator::StartJobs()
+{
+	// requests are queued in order, so the first photos are uploaded first
+	for (auto &job : jobs)
+		UploadPhoto(job);
+}
+
+void ItSeez3D::AvatarBatchGenerator::UploadPhoto(const TSharedRef<Job> &job)
+{
+	auto photoRequest = CreateHttpRequest();
+	photoRequest->SetURL(job->result.photoUrl);
+	photoRequest->SetVerb("GET");
+
+	Submit(photoRequest, [this, job](FHttpResponsePtr response, bool bWasSuccessful)
+	{
+		bool bIsOk;
+		HandleDataResponse(response, bWasSuccessful, bIsOk);
+		if (!bIsOk)
+		{
+			FinishJob(job, false);
+			return;
+		}
+
+		TWeakPtr<AvatarBatchGenerator> weakThis = AsShared();
+		PreprocessPhotoAsync(response, [weakThis, job](const uint8 *data, int64 size, const FString &)
+		{
+			if (auto generator = weakThis.Pin())
+				generator->SubmitPhoto(job, data, size);
+		});
+	});
+}
+
+void ItSeez3D::AvatarBatchGenerator::SubmitPhoto(const TSharedRef<Job> &job, const uint8 *data, int64 size)
+{
+	if (size <= 0)
+	{
+		UE_LOG(LogAvatarSdk, Error, TEXT("No photo to upload for avatar #%d"), job->result.index);
+		FinishJob(job, false);
+		return;
+	}
+
+	MultipartRequestBody form;
+	form.TextField("name", "test_avatar_unreal");
+	form.TextField("description", "test_description_unreal");
+	form.FileField("photo", "photo.jpg", (const char *)data, size);
+	form.Footer();
+
+	// a rejected token is replaced after the request left the queue, the generator may be gone by then
+	TWeakPtr<AvatarBatchGenerator> weakThis = AsShared();
+	SendAuthorized(PostRequest(Url("avatars"), form, AuthSession::Get().GetCredentials()), [weakThis, job](FHttpResponsePtr response, bool bWasSuccessful)
+	{
+		if (auto generator = weakThis.Pin())
+			generator->OnPhotoUploaded(response, bWasSuccessful, job);
+	}, Dispatcher());
+}
+
+void ItSeez3D::AvatarBatchGenerator::OnPhotoUploaded(FHttpResponsePtr response, bool bWasSuccessful, TSharedRef<Job> job)
+{
+	const auto avatar = HandleAvatarResponse(response, bWasSuccessful);
+	if (!avatar.IsValid())
+	{
+		FinishJob(job, false);
+		return;
+	}
+
+	job->avatar = avatar;
+	job->result.avatarCode = job->avatar->code;
+	AvatarStatusPoller::Get().Track(*job->avatar, FOnAvatarStatus::CreateSP(this, &AvatarBatchGenerator::OnStatusUpdated, job));
+}
+
+void ItSeez3D::AvatarBatchGenerator::OnStatusUpdated(TSharedPtr<AvatarData> avatar, TSharedRef<Job> job)
+{
+	if (!avatar.IsValid())
+	{
+		FinishJob(job, false);
+		return;
+	}
+
+	job->avatar = avatar;
+	const auto &status = avatar->status;
+	if (status == "Failed" || status == "Timed Out" || status == "Not Found")
+	{
+		UE_LOG(LogAvatarSdk, Warning, TEXT("Avatar %s calculations failed with status: %s"), *avatar->code, *status);
+		FinishJob(job, false);
+		return;
+	}
+
+	if (status == "Completed")
+	{
+		DownloadMesh(job);
+		DownloadTexture(job);
+	}
+}
+
+void ItSeez3D::AvatarBatchGenerator::DownloadMesh(const TSharedRef<Job> &job)
+{
+	const auto partPath = AssetCache::Get().PartPath(AvatarAssetName(job->avatar->code, TEXT("model.zip")));
+	RangedDownloader::Download(job->avatar->mesh, partPath, FOnAssetDownloaded::CreateSP(this, &AvatarBatchGenerator::OnMeshDownloaded, job), Dispatcher());
+}
+
+void ItSeez3D::AvatarBatchGenerator::OnMeshDownloaded(bool bSucceeded, const FFileBytes &meshResponse, TSharedRef<Job> job)
+{
+	if (!bSucceeded)
+	{
+		FinishJob(job, false);
+		return;
+	}
+
+	TWeakPtr<AvatarBatchGenerator> weakThis = AsShared();
+	AssetCache::Get().PutArchive(AvatarAssetName(job->avatar->code, FString()), meshResponse, [weakThis, job](bool bStored)
+	{
+		if (auto generator = weakThis.Pin())
+			generator->OnMeshStored(bStored, job);
+	});
+}
+
+void ItSeez3D::AvatarBatchGenerator::OnMeshStored(bool bStored, TSharedRef<Job> job)
+{
+	if (!bStored)
+	{
+		FinishJob(job, false);
+		return;
+	}
+
+	// the archive is not needed once its entries are cached
+	HttpCache::Get().Remove(job->avatar->mesh);
+
+	job->result.meshPath = AssetCache::Get().Find(AvatarAssetName(job->avatar->code, TEXT("model.ply")));
+	job->meshDownloaded = true;
+	if (job->textureDownloaded)
+		FinishJob(job, true);
+}
+
+void ItSeez3D::AvatarBatchGenerator::DownloadTexture(const TSharedRef<Job> &job)
+{
+	const auto partPath = AssetCache::Get().PartPath(AvatarAssetName(job->avatar->code, TEXT("model.jpg")));
+	RangedDownloader::Download(job->avatar->texture, partPath, FOnAssetDownloaded::CreateSP(this, &AvatarBatchGenerator::OnTextureDownloaded, job), Dispatcher());
+}
+
+void ItSeez3D::AvatarBatchGenerator::OnTextureDownloaded(bool bSucceeded, const FFileBytes &textureBytes, TSharedRef<Job> job)
+{
+	if (!bSucceeded)
+	{
+		FinishJob(job, false);
+		return;
+	}
+
+	TWeakPtr<AvatarBatchGenerator> weakThis = AsShared();
+	AssetCache::Get().Put(AvatarAssetName(job->avatar->code, TEXT("model.jpg")), textureBytes, [weakThis, job](bool bStored)
+	{
+		if (auto generator = weakThis.Pin())
+			generator->OnTextureStored(bStored, job);
+	});
+}
+
+void ItSeez3D::AvatarBatchGenerator::OnTextureStored(bool bStored, TSharedRef<Job> job)
+{
+	if (!bStored)
+	{
+		FinishJob(job, false);
+		return;
+	}
+
+	job->result.texturePath = AssetCache::Get().Find(AvatarAssetName(job->avatar->code, TEXT("model.jpg")));
+	job->textureDownloaded = true;
+	if (job->meshDownloaded)
+		FinishJob(job, true);
+}
+
+void ItSeez3D::AvatarBatchGenerator::FinishJob(const TSharedRef<Job> &job, bool bSucceeded)
+{
+	if (job->finished)
+		return;
+
+	job->finished = true;
+	job->result.bSucceeded = bSucceeded;
+	job->result.seconds = FPlatformTime::Seconds() - batchStartTime;
+	UE_LOG(LogAvatarSdk, Log, TEXT("Avatar #%d (%s) finished, success: %d, %.1f s"), job->result.index, *job->result.avatarCode, int(bSucceeded), job->result.seconds);
+	onAvatarCompleted.ExecuteIfBound(job->result);
+
+	if (--jobsRemaining > 0)
+		return;
+
+	int32 succeeded = 0;
+	for (const auto &j : jobs)
+		succeeded += j->result.bSucceeded ? 1 : 0;
+	const double elapsed = FPlatformTime::Seconds() - batchStartTime;
+	UE_LOG(LogAvatarSdk, Log, TEXT("Batch finished: %d/%d avatars in %.1f s, throughput %.2f avatars/min, %d concurrent requests"),
+		succeeded, jobs.Num(), elapsed, elapsed > 0 ? 60.0 * succeeded / elapsed : 0.0, maxConcurrentRequests);
+
+	onBatchCompleted.ExecuteIfBound();
+}
+
+namespace
+{
+	TSharedPtr<ItSeez3D::AvatarBatchGenerator> consoleBatch;
+
+	void GenerateBatchCommand(const TArray<FString> &args)
+	{
+		if (consoleBatch.IsValid())
+		{
+			UE_LOG(LogAvatarSdk, Warning, TEXT("Batch is already running"));
+			return;
+		}
+
+		const int32 count = args.Num() > 0 ? FCString::Atoi(*args[0]) : 8;
+		const FString photoUrl = args.Num() > 1 ? args[1] : TEXT("https://s3.amazonaws.com/itseez3d-unreal/test_selfie.jpg");
+		const int32 maxConcurrent = args.Num() > 2 ? FCString::Atoi(*args[2]) : 0;
+
+		TArray<FString> photos;
+		photos.Init(photoUrl, FMath::Max(1, count));
+
+		consoleBatch = MakeShareable(new ItSeez3D::AvatarBatchGenerator(maxConcurrent));
+		consoleBatch->Generate(photos, ItSeez3D::FOnBatchAvatarCompleted(), FSimpleDelegate::CreateLambda([]()
+		{
+			// release on the next tick, we are still inside the generator's callback
+			FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateLambda([](float)
+			{
+				consoleBatch.Reset();
+				return false;
+			}));
+		}));
+	}
+
+	FAutoConsoleCommand generateBatchCommand(
+		TEXT("AvatarSdk.GenerateBatch"),
+		TEXT("Generates N avatars from a single photo and logs batch throughput. Usage: AvatarSdk.GenerateBatch [count] [photoUrl] [maxConcurrentRequests]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&GenerateBatchCommand)
+	);
+}
@@ -0,0 +1,86 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "AvatarApi.h"
+#include "RangedDownloader.h"
+
+
+namespace ItSeez3D
+{
+	struct BatchAvatarResult
+	{
+		int32 index = INDEX_NONE;
+		FString photoUrl;
+		bool bSucceeded = false;
+
+		FString avatarCode;
+		FString meshPath, texturePath;
+
+		// time from the start of the batch until this avatar was ready
+		double seconds = 0;
+	};
+
+	DECLARE_DELEGATE_OneParam(FOnBatchAvatarCompleted, const BatchAvatarResult &);
+
+	/// Generates several avatars with the shared session credentials. Uploads and downloads of all avatars share
+	/// one request queue, at most maxConcurrentRequests of them are in flight. Status polls go through AvatarStatusPoller.
+	class AvatarBatchGenerator : public TSharedFromThis<AvatarBatchGenerator>
+	{
+	public:
+		/// Non-positive limit means "use HttpMaxConnectionsPerServer from the engine config".
+		explicit AvatarBatchGenerator(int32 maxConcurrentRequests = 0);
+
+		/// The generator must be owned by a shared pointer and kept alive until onBatchCompleted fires.
+		/// An empty photo list completes the batch right away.
+		void Generate(const TArray<FString> &photoUrls, const FOnBatchAvatarCompleted &onAvatarCompleted, const FSimpleDelegate &onBatchCompleted = FSimpleDelegate());
+
+		int32 GetMaxConcurrentRequests() const { return maxConcurrentRequests; }
+
+	private:
+		struct Job;
+		typedef TFunction<void(FHttpResponsePtr, bool)> ResponseHandler;
+
+		void Submit(const TSharedRef<IHttpRequest> &request, const ResponseHandler &handler);
+		void OnRequestCompleted(FHttpResponsePtr response, bool bWasSuccessful, ResponseHandler handler);
+		void PumpQueue();
+		FRequestDispatcher Dispatcher();
+
+		void OnCredentialsReady(bool bSucceeded, const Credentials &sessionCredentials);
+		void StartJobs();
+
+		void UploadPhoto(const TSharedRef<Job> &job);
+		void SubmitPhoto(const TSharedRef<Job> &job, const uint8 *data, int64 size);
+		void OnPhotoUploaded(FHttpResponsePtr response, bool bWasSuccessful, TSharedRef<Job> job);
+		void OnStatusUpdated(TSharedPtr<AvatarData> avatar, TSharedRef<Job> job);
+		void DownloadMesh(const TSharedRef<Job> &job);
+		void OnMeshDownloaded(bool bSucceeded, const FFileBytes &meshResponse, TSharedRef<Job> job);
+		void OnMeshStored(bool bStored, TSharedRef<Job> job);
+		void DownloadTexture(const TSharedRef<Job> &job);
+		void OnTextureDownloaded(bool bSucceeded, const FFileBytes &textureBytes, TSharedRef<Job> job);
+		void OnTextureStored(bool bStored, TSharedRef<Job> job);
+		void FinishJob(const TSharedRef<Job> &job, bool bSucceeded);
+
+	private:
+		int32 maxConcurrentRequests;
+		int32 requestsInFlight = 0;
+		TArray<TPair<TSharedRef<IHttpRequest>, ResponseHandler>> pendingRequests;
+
+		TArray<TSharedRef<Job>> jobs;
+		int32 jobsRemaining = 0;
+		double batchStartTime = 0;
+
+		FOnBatchAvatarCompleted onAvatarCompleted;
+		FSimpleDelegate onBatchCompleted;
+	};
+}
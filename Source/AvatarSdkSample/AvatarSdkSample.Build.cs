@@ -11,5 +11,9 @@ public class AvatarSdkSample : ModuleRules
 		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "HeadMountedDisplay", "Http", "Json", "JsonUtilities", "ProceduralMeshComponent", "zlib" });
 
         Definitions.Add("USE_FILE32API");
+
+        // DPAPI for the stored credentials
+        if (Target.Platform == UnrealTargetPlatform.Win64 || Target.Platform == UnrealTargetPlatform.Win32)
+            PublicAdditionalLibraries.Add("Crypt32.lib");
     }
 }
@@ -3,5 +3,9 @@
 #include "AvatarSdkSample.h"
 #include "Modules/ModuleManager.h"
 
+DEFINE_LOG_CATEGORY(LogAvatarSdk);
+
+const TCHAR *const configSection = TEXT("/Script/AvatarSdkSample.AvatarSdk");
+
 IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, AvatarSdkSample, "AvatarSdkSample" );
  
\ No newline at end of file
@@ -3,3 +3,9 @@
 #pragma once
 
 #include "CoreMinimal.h"
+
+// shared by all avatar sdk code of the module
+DECLARE_LOG_CATEGORY_EXTERN(LogAvatarSdk, Log, All);
+
+// section of the avatar sdk settings in the game config
+extern const TCHAR *const configSection;
@@ -0,0 +1,39 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+
+
+// "stat AvatarSdk" in the console shows these values
+DECLARE_STATS_GROUP(TEXT("AvatarSDK"), STATGROUP_AvatarSdk, STATCAT_Advanced);
+
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Status polls"), STAT_AvatarSdk_StatusPolls, STATGROUP_AvatarSdk, );
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Completion detection delay avg (s)"), STAT_AvatarSdk_DetectionDelayAvg, STATGROUP_AvatarSdk, );
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Completion detection delay p95 (s)"), STAT_AvatarSdk_DetectionDelayP95, STATGROUP_AvatarSdk, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Photo upload KB saved"), STAT_AvatarSdk_PhotoKBSaved, STATGROUP_AvatarSdk, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Download KB resumed"), STAT_AvatarSdk_DownloadKBResumed, STATGROUP_AvatarSdk, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Download KB re-fetched"), STAT_AvatarSdk_DownloadKBRefetched, STATGROUP_AvatarSdk, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Http cache hits"), STAT_AvatarSdk_HttpCacheHits, STATGROUP_AvatarSdk, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Http cache misses"), STAT_AvatarSdk_HttpCacheMisses, STATGROUP_AvatarSdk, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Http cache revalidations"), STAT_AvatarSdk_HttpCacheRevalidations, STATGROUP_AvatarSdk, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Haircut prefetch hits"), STAT_AvatarSdk_PrefetchHits, STATGROUP_AvatarSdk, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Haircut prefetch misses"), STAT_AvatarSdk_PrefetchMisses, STATGROUP_AvatarSdk, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Downloads deduplicated"), STAT_AvatarSdk_DownloadsDeduplicated, STATGROUP_AvatarSdk, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Http KB over the wire"), STAT_AvatarSdk_HttpWireKB, STATGROUP_AvatarSdk, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Http KB decoded"), STAT_AvatarSdk_HttpDecodedKB, STATGROUP_AvatarSdk, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Asset cache KB"), STAT_AvatarSdk_AssetCacheKB, STATGROUP_AvatarSdk, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Asset cache KB deduplicated"), STAT_AvatarSdk_AssetCacheDeduplicatedKB, STATGROUP_AvatarSdk, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Asset cache KB evicted"), STAT_AvatarSdk_AssetCacheEvictedKB, STATGROUP_AvatarSdk, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Asset cache damaged blobs"), STAT_AvatarSdk_AssetCacheDamagedBlobs, STATGROUP_AvatarSdk, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Asset body KB copied"), STAT_AvatarSdk_BodyCopiedKB, STATGROUP_AvatarSdk, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Directory checks"), STAT_AvatarSdk_DirectoryChecks, STATGROUP_AvatarSdk, );
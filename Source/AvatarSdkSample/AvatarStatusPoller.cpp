@@ -0,0 +1,176 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#include "AvatarStatusPoller.h"
+
+#include "Containers/Ticker.h"
+#include "Misc/ConfigCacheIni.h"
+
+#include "AuthSession.h"
+#include "AvatarSdkSample.h"
+
+
+namespace
+{
+	// how often due avatars are checked, seconds
+	const float tickInterval = 0.1f;
+
+	bool IsFinalStatus(const FString &status)
+	{
+		return status == "Completed" || status == "Failed" || status == "Timed Out" || status == "Not Found";
+	}
+}
+
+ItSeez3D::AvatarStatusPoller & ItSeez3D::AvatarStatusPoller::Get()
+{
+	static AvatarStatusPoller poller;
+	return poller;
+}
+
+ItSeez3D::AvatarStatusPoller::AvatarStatusPoller()
+{
+	requestsPerSecond = 4.0f;
+	if (GConfig)
+		GConfig->GetFloat(configSection, TEXT("StatusRequestsPerSecond"), requestsPerSecond, GGameIni);
+	requestsPerSecond = FMath::Max(0.1f, requestsPerSecond);
+}
+
+void ItSeez3D::AvatarStatusPoller::Track(const AvatarData &avatar, const FOnAvatarStatus &listener)
+{
+	const double now = FPlatformTime::Seconds();
+
+	if (auto existing = entries.Find(avatar.code))
+	{
+		UE_LOG(LogAvatarSdk, Log, TEXT("Avatar %s is already polled, sharing its requests"), *avatar.code);
+		(*existing)->listeners.Add(listener);
+		return;
+	}
+
+	TSharedRef<Entry> entry = MakeShareable(new Entry());
+	entry->code = avatar.code;
+	entry->listeners.Add(listener);
+
+	// the schedule learns from real responses only, the first one is asked for right away
+	entry->nextPollTime = now;
+	entries.Add(entry->code, entry);
+
+	if (!tickerHandle.IsValid())
+	{
+		lastBudgetUpdate = now;
+		budget = 1;
+		tickerHandle = FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &AvatarStatusPoller::Tick), tickInterval);
+	}
+
+	// avatars tracked at the same moment beyond the budget wait for the ticker
+	if (budget >= 1)
+	{
+		budget -= 1;
+		Poll(entry);
+	}
+}
+
+bool ItSeez3D::AvatarStatusPoller::Tick(float deltaTime)
+{
+	const double now = FPlatformTime::Seconds();
+	budget = FMath::Min<double>(FMath::Max(1.0f, requestsPerSecond), budget + (now - lastBudgetUpdate) * requestsPerSecond);
+	lastBudgetUpdate = now;
+
+	TArray<TSharedRef<Entry>> due;
+	for (auto it = entries.CreateIterator(); it; ++it)
+	{
+		auto &entry = it.Value();
+		entry->listeners.RemoveAll([](const FOnAvatarStatus &listener) { return !listener.IsBound(); });
+		if (entry->listeners.Num() == 0 && !entry->requestInFlight)
+		{
+			UE_LOG(LogAvatarSdk, Log, TEXT("Nobody waits for avatar %s anymore, stop polling"), *entry->code);
+			it.RemoveCurrent();
+			continue;
+		}
+
+		if (!entry->requestInFlight && entry->nextPollTime <= now)
+			due.Add(entry);
+	}
+
+	// the most overdue avatars go first when the budget is short
+	due.Sort([](const TSharedRef<Entry> &a, const TSharedRef<Entry> &b) { return a->nextPollTime < b->nextPollTime; });
+	for (const auto &entry : due)
+	{
+		if (budget < 1)
+			break;
+		budget -= 1;
+		Poll(entry);
+	}
+
+	if (entries.Num() == 0)
+	{
+		tickerHandle.Reset();
+		return false;
+	}
+	return true;
+}
+
+void ItSeez3D::AvatarStatusPoller::Poll(const TSharedRef<Entry> &entry)
+{
+	entry->requestInFlight = true;
+
+	UE_LOG(LogAvatarSdk, Log, TEXT("Updating status for avatar: %s, %d avatars pending"), *entry->code, entries.Num());
+	SendAuthorized(GetRequest(Url("avatars", entry->code), AuthSession::Get().GetCredentials()), [this, entry](FHttpResponsePtr response, bool bWasSuccessful)
+	{
+		OnStatusReceived(entry, response, bWasSuccessful);
+	});
+}
+
+void ItSeez3D::AvatarStatusPoller::OnStatusReceived(const TSharedRef<Entry> &entry, FHttpResponsePtr response, bool bWasSuccessful)
+{
+	entry->requestInFlight = false;
+	const double now = FPlatformTime::Seconds();
+
+	TSharedPtr<AvatarData> avatar;
+	if (bWasSuccessful && response.IsValid() && response->GetResponseCode() == EHttpResponseCodes::NotFound)
+	{
+		// a definite answer, retrying won't help
+		UE_LOG(LogAvatarSdk, Warning, TEXT("Avatar %s does not exist on the server"), *entry->code);
+		avatar = MakeShareable(new AvatarData());
+		avatar->code = entry->code;
+		avatar->status = TEXT("Not Found");
+	}
+	else
+		avatar = HandleAvatarResponse(response, bWasSuccessful);
+
+	if (!avatar.IsValid())
+	{
+		entry->schedule.OnError();
+		if (entry->schedule.ShouldRetry())
+		{
+			entry->nextPollTime = now + entry->schedule.NextDelay(now);
+			return;
+		}
+
+		UE_LOG(LogAvatarSdk, Error, TEXT("Giving up on avatar %s after repeated errors"), *entry->code);
+		entries.Remove(entry->code);
+		Notify(entry, TSharedPtr<AvatarData>());
+		return;
+	}
+
+	entry->schedule.OnStatus(now, avatar->progress, avatar->status == "Completed");
+	entry->nextPollTime = now + entry->schedule.NextDelay(now);
+
+	if (IsFinalStatus(avatar->status))
+		entries.Remove(entry->code);
+	Notify(entry, avatar);
+}
+
+void ItSeez3D::AvatarStatusPoller::Notify(const TSharedRef<Entry> &entry, TSharedPtr<AvatarData> avatar)
+{
+	// listeners may track other avatars from inside the callback
+	const auto listeners = entry->listeners;
+	for (const auto &listener : listeners)
+		listener.ExecuteIfBound(avatar);
+}
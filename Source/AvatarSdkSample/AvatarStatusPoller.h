@@ -0,0 +1,64 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "AvatarApi.h"
+#include "StatusPolling.h"
+
+
+namespace ItSeez3D
+{
+	/// Receives every fresh status of the tracked avatar. Invalid pointer means polling gave up after repeated network
+	/// or server errors, the avatar may still exist. Status "Not Found" means the server does not know the code.
+	DECLARE_DELEGATE_OneParam(FOnAvatarStatus, TSharedPtr<AvatarData>);
+
+	/// Process-wide poller for avatars that are being computed on the server.
+	/// All pending avatars share one ticker and one request budget (StatusRequestsPerSecond in the game config),
+	/// each avatar is polled on its own adaptive schedule, listeners of the same avatar share one request.
+	class AvatarStatusPoller
+	{
+	public:
+		static AvatarStatusPoller & Get();
+
+		/// Polls the avatar right away if the budget allows, then until it is completed or failed. The listener is dropped once it gets unbound
+		/// (e.g. its UObject was destroyed).
+		void Track(const AvatarData &avatar, const FOnAvatarStatus &listener);
+
+		int32 NumTracked() const { return entries.Num(); }
+
+	private:
+		AvatarStatusPoller();
+
+		struct Entry
+		{
+			FString code;
+			StatusPollSchedule schedule;
+			double nextPollTime = 0;
+			bool requestInFlight = false;
+			TArray<FOnAvatarStatus> listeners;
+		};
+
+		bool Tick(float deltaTime);
+		void Poll(const TSharedRef<Entry> &entry);
+		void OnStatusReceived(const TSharedRef<Entry> &entry, FHttpResponsePtr response, bool bWasSuccessful);
+		void Notify(const TSharedRef<Entry> &entry, TSharedPtr<AvatarData> avatar);
+
+	private:
+		TMap<FString, TSharedRef<Entry>> entries;
+		FDelegateHandle tickerHandle;
+
+		float requestsPerSecond;
+		double budget = 0;
+		double lastBudgetUpdate = 0;
+	};
+}
@@ -0,0 +1,285 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#include "AvatarTexture.h"
+
+#include "ModuleManager.h"
+#include "Async/Async.h"
+#include "Async/ParallelFor.h"
+#include "HAL/IConsoleManager.h"
+
+#include "Runtime/Engine/Classes/Engine/Texture2D.h"
+#include "Runtime/ImageWrapper/Public/Interfaces/IImageWrapperModule.h"
+
+#include "AvatarSdkSample.h"
+#include "AvatarSdkStats.h"
+#include "BlockCompression.h"
+
+
+DECLARE_CYCLE_STAT(TEXT("Texture decoding"), STAT_AvatarSdk_TextureDecode, STATGROUP_AvatarSdk);
+DECLARE_CYCLE_STAT(TEXT("Texture mips generation"), STAT_AvatarSdk_TextureMips, STATGROUP_AvatarSdk);
+DECLARE_CYCLE_STAT(TEXT("Texture compression"), STAT_AvatarSdk_TextureCompress, STATGROUP_AvatarSdk);
+DECLARE_CYCLE_STAT(TEXT("Texture creation"), STAT_AvatarSdk_TextureCreate, STATGROUP_AvatarSdk);
+
+
+namespace
+{
+	// source texels along one axis averaged into mip texel i, the last texel of an odd size takes three
+	int32 MipTaps(int32 i, int32 size, int32 mipSize)
+	{
+		if (size == 1)
+			return 1;
+		return i == mipSize - 1 && size % 2 == 1 ? 3 : 2;
+	}
+
+	// sRGB byte to linear, and linear quantized to 4096 steps back to sRGB byte
+	struct SrgbTables
+	{
+		float toLinear[256];
+		uint8 fromLinear[4096];
+
+		SrgbTables()
+		{
+			for (int32 i = 0; i < 256; ++i)
+			{
+				const float c = i / 255.0f;
+				toLinear[i] = c <= 0.04045f ? c / 12.92f : FMath::Pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+			for (int32 i = 0; i < 4096; ++i)
+			{
+				const float l = i / 4095.0f;
+				const float c = l <= 0.0031308f ? l * 12.92f : 1.055f * FMath::Pow(l, 1.0f / 2.4f) - 0.055f;
+				fromLinear[i] = uint8(FMath::Clamp(FMath::RoundToInt(c * 255.0f), 0, 255));
+			}
+		}
+	};
+
+	const SrgbTables & Srgb()
+	{
+		static const SrgbTables tables;
+		return tables;
+	}
+
+	void EncodeTexel(const float *linear, bool bAlphaAware, uint8 *bgra)
+	{
+		const auto &srgb = Srgb();
+		const float alpha = linear[3];
+		const float scale = !bAlphaAware ? 1.0f : alpha > 0 ? 1.0f / alpha : 0.0f;
+		for (int32 c = 0; c < 3; ++c)
+			bgra[c] = srgb.fromLinear[FMath::Clamp(FMath::RoundToInt(linear[c] * scale * 4095.0f), 0, 4095)];
+		bgra[3] = uint8(FMath::Clamp(FMath::RoundToInt(alpha * 255.0f), 0, 255));
+	}
+
+	// BC1 for the opaque head, BC3 for the hair alpha
+	void CompressMips(ItSeez3D::DecodedTexture &texture, EPixelFormat format, ItSeez3D::BlockCompressionQuality quality)
+	{
+		SCOPE_CYCLE_COUNTER(STAT_AvatarSdk_TextureCompress);
+
+		const double startTime = FPlatformTime::Seconds();
+		int64 sourceBytes = 0, compressedBytes = 0;
+		for (int32 level = 0; level < texture.mips.Num(); ++level)
+		{
+			TArray<uint8> blocks;
+			ItSeez3D::CompressBlocks(texture.mips[level].GetData(), FMath::Max(1, texture.width >> level), FMath::Max(1, texture.height >> level), format, quality, blocks);
+			sourceBytes += texture.mips[level].Num();
+			compressedBytes += blocks.Num();
+			texture.mips[level] = MoveTemp(blocks);
+		}
+		texture.format = format;
+
+		const double seconds = FPlatformTime::Seconds() - startTime;
+		UE_LOG(LogAvatarSdk, Log, TEXT("%dx%d texture compressed to %s, %lld -> %lld KB in %.1f ms, %.1f MB/s"), texture.width, texture.height,
+			format == PF_DXT1 ? TEXT("BC1") : TEXT("BC3"), sourceBytes / 1024, compressedBytes / 1024, seconds * 1000.0,
+			sourceBytes / (1024.0 * 1024.0) / FMath::Max(seconds, 1e-6));
+	}
+}
+
+
+
+ItSeez3D::FDecodedTexturePtr ItSeez3D::DecodeTexture(const TArray<uint8> &compressed, EImageFormat::Type format)
+{
+	SCOPE_CYCLE_COUNTER(STAT_AvatarSdk_TextureDecode);
+
+	auto &imageWrapperModule = FModuleManager::GetModuleChecked<IImageWrapperModule>(FName("ImageWrapper"));
+	IImageWrapperPtr imageWrapper = imageWrapperModule.CreateImageWrapper(format);
+	const TArray<uint8> *bgra = nullptr;
+	if (!imageWrapper.IsValid() || !imageWrapper->SetCompressed(compressed.GetData(), compressed.Num()) || !imageWrapper->GetRaw(ERGBFormat::BGRA, 8, bgra))
+	{
+		UE_LOG(LogAvatarSdk, Warning, TEXT("Unable to decode texture of %d bytes"), compressed.Num());
+		return nullptr;
+	}
+
+	FDecodedTexturePtr decoded = MakeShareable(new DecodedTexture());
+	decoded->width = imageWrapper->GetWidth();
+	decoded->height = imageWrapper->GetHeight();
+	decoded->mips.Add(*bgra);
+
+	// the hair PNG keeps its coverage in alpha, the head JPEG is opaque
+	const double startTime = FPlatformTime::Seconds();
+	GenerateMips(*decoded, format == EImageFormat::PNG);
+	const double seconds = FPlatformTime::Seconds() - startTime;
+	UE_LOG(LogAvatarSdk, Log, TEXT("%d mips of %dx%d texture in %.1f ms, %.1f ms per 2K texture"), decoded->mips.Num() - 1, decoded->width, decoded->height,
+		seconds * 1000.0, seconds * 1000.0 * 2048.0 * 2048.0 / FMath::Max(1, decoded->width * decoded->height));
+
+	// block compressed textures need whole blocks at the top level
+	const auto quality = TextureCompressionQuality();
+	if (quality != BlockCompressionQuality::NONE && decoded->width % 4 == 0 && decoded->height % 4 == 0)
+		CompressMips(*decoded, format == EImageFormat::PNG ? PF_DXT5 : PF_DXT1, quality);
+	return decoded;
+}
+
+void ItSeez3D::GenerateMips(DecodedTexture &texture, bool bAlphaAware)
+{
+	SCOPE_CYCLE_COUNTER(STAT_AvatarSdk_TextureMips);
+	check(texture.mips.Num() == 1);
+
+	const auto &srgb = Srgb();
+	int32 w = texture.width, h = texture.height;
+
+	// float BGRA in linear space, premultiplied for the alpha-aware filter
+	TArray<float> level, next;
+	level.SetNumUninitialized(w * h * 4);
+	const uint8 *src = texture.mips[0].GetData();
+	ParallelFor(h, [&](int32 y)
+	{
+		for (int32 x = 0; x < w; ++x)
+		{
+			const int64 i = (int64(y) * w + x) * 4;
+			const float alpha = src[i + 3] / 255.0f;
+			const float weight = bAlphaAware ? alpha : 1.0f;
+			float *dst = level.GetData() + i;
+			dst[0] = srgb.toLinear[src[i]] * weight;
+			dst[1] = srgb.toLinear[src[i + 1]] * weight;
+			dst[2] = srgb.toLinear[src[i + 2]] * weight;
+			dst[3] = alpha;
+		}
+	});
+
+	// each level is filtered from the float one above, one pixel per vector register
+	const VectorRegister quarter = VectorSetFloat1(0.25f);
+	while (w > 1 || h > 1)
+	{
+		const int32 mipWidth = FMath::Max(1, w / 2), mipHeight = FMath::Max(1, h / 2);
+		next.SetNumUninitialized(mipWidth * mipHeight * 4);
+		TArray<uint8> mip;
+		mip.SetNumUninitialized(mipWidth * mipHeight * 4);
+		ParallelFor(mipHeight, [&](int32 y)
+		{
+			const int32 rowTaps = MipTaps(y, h, mipHeight);
+			const float *row0 = level.GetData() + int64(2 * y) * w * 4;
+			for (int32 x = 0; x < mipWidth; ++x)
+			{
+				const int32 columnTaps = MipTaps(x, w, mipWidth);
+				const int64 i = (int64(y) * mipWidth + x) * 4;
+				if (rowTaps == 2 && columnTaps == 2)
+				{
+					const float *texel = row0 + 2 * x * 4;
+					const VectorRegister sum = VectorAdd(VectorAdd(VectorLoad(texel), VectorLoad(texel + 4)),
+						VectorAdd(VectorLoad(texel + w * 4), VectorLoad(texel + w * 4 + 4)));
+					VectorStore(VectorMultiply(sum, quarter), next.GetData() + i);
+				}
+				else
+				{
+					// edge of a texture with an odd or unit size
+					VectorRegister sum = VectorZero();
+					for (int32 ry = 0; ry < rowTaps; ++ry)
+					{
+						for (int32 rx = 0; rx < columnTaps; ++rx)
+							sum = VectorAdd(sum, VectorLoad(row0 + (int64(ry) * w + 2 * x + rx) * 4));
+					}
+					VectorStore(VectorMultiply(sum, VectorSetFloat1(1.0f / (rowTaps * columnTaps))), next.GetData() + i);
+				}
+				EncodeTexel(next.GetData() + i, bAlphaAware, mip.GetData() + i);
+			}
+		});
+
+		texture.mips.Add(MoveTemp(mip));
+		Swap(level, next);
+		w = mipWidth;
+		h = mipHeight;
+	}
+}
+
+void ItSeez3D::DecodeTextureAsync(const FFileBytes &compressed, EImageFormat::Type format, const FOnTextureDecoded &onDecoded)
+{
+	// make sure the module is loaded on the game thread before worker threads use it
+	FModuleManager::LoadModuleChecked<IImageWrapperModule>(FName("ImageWrapper"));
+
+	AsyncTask(ENamedThreads::AnyThread, [compressed, format, onDecoded]()
+	{
+		const FDecodedTexturePtr decoded = DecodeTexture(*compressed, format);
+		AsyncTask(ENamedThreads::GameThread, [decoded, onDecoded]()
+		{
+			onDecoded(decoded);
+		});
+	});
+}
+
+UTexture2D * ItSeez3D::CreateAvatarTexture(const DecodedTexture &decoded)
+{
+	SCOPE_CYCLE_COUNTER(STAT_AvatarSdk_TextureCreate);
+	check(IsInGameThread());
+
+	UTexture2D *texture = UTexture2D::CreateTransient(decoded.width, decoded.height, decoded.format);
+	if (!texture)
+		return nullptr;
+
+	// CreateTransient makes the first mip only
+	auto &mips = texture->PlatformData->Mips;
+	for (int32 level = 0; level < decoded.mips.Num(); ++level)
+	{
+		if (level >= mips.Num())
+		{
+			FTexture2DMipMap *mip = new FTexture2DMipMap();
+			mip->SizeX = FMath::Max(1, decoded.width >> level);
+			mip->SizeY = FMath::Max(1, decoded.height >> level);
+			mips.Add(mip);
+		}
+
+		auto &bulkData = mips[level].BulkData;
+		bulkData.Lock(LOCK_READ_WRITE);
+		void *textureBytes = bulkData.Realloc(decoded.mips[level].Num());
+		FMemory::Memcpy(textureBytes, decoded.mips[level].GetData(), decoded.mips[level].Num());
+		bulkData.Unlock();
+	}
+	texture->UpdateResource();
+	return texture;
+}
+
+namespace
+{
+	void BenchmarkMipsCommand(const TArray<FString> &args)
+	{
+		const int32 size = args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*args[0])) : 2048;
+		const int32 iterations = args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*args[1])) : 10;
+		ItSeez3D::DecodedTexture source;
+		source.width = source.height = size;
+		source.mips.Add(ItSeez3D::MakeBenchmarkTexture(size));
+
+		for (const bool bAlphaAware : { false, true })
+		{
+			const double startTime = FPlatformTime::Seconds();
+			for (int32 i = 0; i < iterations; ++i)
+			{
+				auto texture = source;
+				ItSeez3D::GenerateMips(texture, bAlphaAware);
+			}
+			const double seconds = (FPlatformTime::Seconds() - startTime) / iterations;
+			UE_LOG(LogAvatarSdk, Log, TEXT("Mip chain of %dx%d texture, %s: %.2f ms, %.1f MB/s"), size, size,
+				bAlphaAware ? TEXT("alpha-aware") : TEXT("opaque"), seconds * 1000.0, size * size * 4 / (1024.0 * 1024.0) / seconds);
+		}
+	}
+
+	FAutoConsoleCommand benchmarkMipsCommand(
+		TEXT("AvatarSdk.BenchmarkMips"),
+		TEXT("Times mip chain generation of a synthetic texture. Usage: AvatarSdk.BenchmarkMips [size] [iterations]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&BenchmarkMipsCommand)
+	);
+}
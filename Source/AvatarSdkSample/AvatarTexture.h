@@ -0,0 +1,52 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PixelFormat.h"
+
+#include "Runtime/ImageWrapper/Public/Interfaces/IImageWrapper.h"
+
+#include "AsyncFileIO.h"
+
+
+class UTexture2D;
+
+namespace ItSeez3D
+{
+	/// Texture decoded with its full mip chain, ready to be copied into a transient UTexture2D.
+	/// The mips are BGRA8, or BC1/BC3 blocks unless TextureCompression (game config) is None.
+	struct DecodedTexture
+	{
+		int32 width = 0, height = 0;
+		EPixelFormat format = PF_B8G8R8A8;
+		TArray<TArray<uint8>> mips;
+	};
+
+	typedef TSharedPtr<DecodedTexture, ESPMode::ThreadSafe> FDecodedTexturePtr;
+
+	/// Receives the decoded texture on the game thread, null if the image could not be decoded.
+	typedef TFunction<void(const FDecodedTexturePtr &)> FOnTextureDecoded;
+
+	/// Decodes the JPEG or PNG, generates its mips and compresses them, safe to call on worker threads.
+	FDecodedTexturePtr DecodeTexture(const TArray<uint8> &compressed, EImageFormat::Type format);
+
+	/// Appends the mips below mips[0] with a 2x2 box filter in linear space. The alpha-aware filter weights
+	/// colors by alpha, so transparent texels don't darken the edges of the hair. The last column or row of an odd
+	/// size is folded into the last texel of the smaller mip, so no source texel is dropped.
+	void GenerateMips(DecodedTexture &texture, bool bAlphaAware);
+
+	/// Runs DecodeTexture in a task graph job.
+	void DecodeTextureAsync(const FFileBytes &compressed, EImageFormat::Type format, const FOnTextureDecoded &onDecoded);
+
+	/// Creates the transient texture and starts its resource update, the only part that needs the game thread.
+	UTexture2D * CreateAvatarTexture(const DecodedTexture &decoded);
+}
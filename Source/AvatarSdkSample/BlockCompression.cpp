@@ -0,0 +1,517 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#include "BlockCompression.h"
+
+#include "Async/ParallelFor.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/ConfigCacheIni.h"
+
+#include "AvatarSdkSample.h"
+
+
+namespace
+{
+	using ItSeez3D::BlockCompressionQuality;
+
+	// 4x4 texels, BGRA8 each
+	typedef uint8 FBlockTexels[64];
+
+	void LoadBlock(const uint8 *bgra, int32 width, int32 height, int32 blockX, int32 blockY, FBlockTexels texels)
+	{
+		for (int32 y = 0; y < 4; ++y)
+		{
+			const int32 sourceY = FMath::Min(blockY * 4 + y, height - 1);
+			for (int32 x = 0; x < 4; ++x)
+			{
+				const int32 sourceX = FMath::Min(blockX * 4 + x, width - 1);
+				FMemory::Memcpy(texels + (y * 4 + x) * 4, bgra + (int64(sourceY) * width + sourceX) * 4, 4);
+			}
+		}
+	}
+
+	void StoreBlock(const FBlockTexels texels, int32 width, int32 height, int32 blockX, int32 blockY, uint8 *bgra)
+	{
+		for (int32 y = 0; y < 4 && blockY * 4 + y < height; ++y)
+		{
+			for (int32 x = 0; x < 4 && blockX * 4 + x < width; ++x)
+				FMemory::Memcpy(bgra + (int64(blockY * 4 + y) * width + blockX * 4 + x) * 4, texels + (y * 4 + x) * 4, 4);
+		}
+	}
+
+	// colors are float BGR in 0..255 while the endpoints are searched
+	uint16 To565(const float *bgr)
+	{
+		const int32 b = FMath::Clamp(FMath::RoundToInt(bgr[0] * 31.0f / 255.0f), 0, 31);
+		const int32 g = FMath::Clamp(FMath::RoundToInt(bgr[1] * 63.0f / 255.0f), 0, 63);
+		const int32 r = FMath::Clamp(FMath::RoundToInt(bgr[2] * 31.0f / 255.0f), 0, 31);
+		return uint16((r << 11) | (g << 5) | b);
+	}
+
+	void From565(uint16 color, int32 *bgr)
+	{
+		const int32 r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+		bgr[0] = (b << 3) | (b >> 2);
+		bgr[1] = (g << 2) | (g >> 4);
+		bgr[2] = (r << 3) | (r >> 2);
+	}
+
+	// four color mode palette, BC3 color blocks always decode this way and BC1 does when color0 > color1
+	void ColorPalette(uint16 color0, uint16 color1, int32 palette[4][3])
+	{
+		From565(color0, palette[0]);
+		From565(color1, palette[1]);
+		for (int32 c = 0; c < 3; ++c)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+	}
+
+	// orders the endpoints for the four color mode and picks the nearest palette entry per texel, returns the squared error
+	int32 SelectColorIndices(const FBlockTexels texels, uint16 &color0, uint16 &color1, uint32 &indices)
+	{
+		if (color0 < color1)
+			Swap(color0, color1);
+
+		int32 palette[4][3];
+		ColorPalette(color0, color1, palette);
+		const int32 entries = color0 == color1 ? 1 : 4;
+
+		indices = 0;
+		int32 error = 0;
+		for (int32 i = 0; i < 16; ++i)
+		{
+			const uint8 *texel = texels + i * 4;
+			int32 best = 0, bestError = MAX_int32;
+			for (int32 p = 0; p < entries; ++p)
+			{
+				const int32 db = texel[0] - palette[p][0], dg = texel[1] - palette[p][1], dr = texel[2] - palette[p][2];
+				const int32 e = db * db + dg * dg + dr * dr;
+				if (e < bestError)
+				{
+					bestError = e;
+					best = p;
+				}
+			}
+			indices |= uint32(best) << (i * 2);
+			error += bestError;
+		}
+		return error;
+	}
+
+	// bounding box of the block colors, inset a little because the extremes are rarely hit
+	void BoundingBoxEndpoints(const FBlockTexels texels, float *minColor, float *maxColor)
+	{
+		for (int32 c = 0; c < 3; ++c)
+		{
+			minColor[c] = 255.0f;
+			maxColor[c] = 0.0f;
+		}
+		for (int32 i = 0; i < 16; ++i)
+		{
+			for (int32 c = 0; c < 3; ++c)
+			{
+				minColor[c] = FMath::Min<float>(minColor[c], texels[i * 4 + c]);
+				maxColor[c] = FMath::Max<float>(maxColor[c], texels[i * 4 + c]);
+			}
+		}
+		for (int32 c = 0; c < 3; ++c)
+		{
+			const float inset = (maxColor[c] - minColor[c]) / 16.0f;
+			minColor[c] += inset;
+			maxColor[c] -= inset;
+		}
+	}
+
+	// extremes of the block colors projected on their principal axis
+	void PrincipalAxisEndpoints(const FBlockTexels texels, float *minColor, float *maxColor)
+	{
+		float mean[3] = { 0, 0, 0 };
+		for (int32 i = 0; i < 16; ++i)
+		{
+			for (int32 c = 0; c < 3; ++c)
+				mean[c] += texels[i * 4 + c] / 16.0f;
+		}
+
+		float covariance[3][3] = {};
+		for (int32 i = 0; i < 16; ++i)
+		{
+			float d[3];
+			for (int32 c = 0; c < 3; ++c)
+				d[c] = texels[i * 4 + c] - mean[c];
+			for (int32 a = 0; a < 3; ++a)
+			{
+				for (int32 b = 0; b < 3; ++b)
+					covariance[a][b] += d[a] * d[b];
+			}
+		}
+
+		// power iteration, a few steps are enough for the dominant axis of 16 colors
+		float axis[3] = { 1, 1, 1 };
+		for (int32 iteration = 0; iteration < 8; ++iteration)
+		{
+			float next[3];
+			for (int32 a = 0; a < 3; ++a)
+				next[a] = covariance[a][0] * axis[0] + covariance[a][1] * axis[1] + covariance[a][2] * axis[2];
+			const float length = FMath::Sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+			if (length < KINDA_SMALL_NUMBER)
+			{
+				// flat block, or no spread along the starting axis
+				BoundingBoxEndpoints(texels, minColor, maxColor);
+				return;
+			}
+			for (int32 c = 0; c < 3; ++c)
+				axis[c] = next[c] / length;
+		}
+
+		float minT = MAX_flt, maxT = -MAX_flt;
+		for (int32 i = 0; i < 16; ++i)
+		{
+			const float t = (texels[i * 4] - mean[0]) * axis[0] + (texels[i * 4 + 1] - mean[1]) * axis[1] + (texels[i * 4 + 2] - mean[2]) * axis[2];
+			minT = FMath::Min(minT, t);
+			maxT = FMath::Max(maxT, t);
+		}
+		for (int32 c = 0; c < 3; ++c)
+		{
+			minColor[c] = FMath::Clamp(mean[c] + axis[c] * minT, 0.0f, 255.0f);
+			maxColor[c] = FMath::Clamp(mean[c] + axis[c] * maxT, 0.0f, 255.0f);
+		}
+	}
+
+	// endpoints that best reproduce the texels with the chosen indices, in the least squares sense
+	bool RefineEndpoints(const FBlockTexels texels, uint32 indices, uint16 &color0, uint16 &color1)
+	{
+		static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+		float aa = 0, ab = 0, bb = 0;
+		float ax[3] = { 0, 0, 0 }, bx[3] = { 0, 0, 0 };
+		for (int32 i = 0; i < 16; ++i)
+		{
+			const float a = weights[(indices >> (i * 2)) & 3], b = 1.0f - a;
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+			for (int32 c = 0; c < 3; ++c)
+			{
+				ax[c] += a * texels[i * 4 + c];
+				bx[c] += b * texels[i * 4 + c];
+			}
+		}
+
+		const float determinant = aa * bb - ab * ab;
+		if (FMath::Abs(determinant) < KINDA_SMALL_NUMBER)
+			return false;
+
+		float end0[3], end1[3];
+		for (int32 c = 0; c < 3; ++c)
+		{
+			end0[c] = FMath::Clamp((bb * ax[c] - ab * bx[c]) / determinant, 0.0f, 255.0f);
+			end1[c] = FMath::Clamp((aa * bx[c] - ab * ax[c]) / determinant, 0.0f, 255.0f);
+		}
+		color0 = To565(end0);
+		color1 = To565(end1);
+		return true;
+	}
+
+	void EncodeColorBlock(const FBlockTexels texels, BlockCompressionQuality quality, uint8 *out)
+	{
+		float minColor[3], maxColor[3];
+		if (quality == BlockCompressionQuality::QUALITY)
+			PrincipalAxisEndpoints(texels, minColor, maxColor);
+		else
+			BoundingBoxEndpoints(texels, minColor, maxColor);
+
+		uint16 color0 = To565(maxColor), color1 = To565(minColor);
+		uint32 indices = 0;
+		int32 error = SelectColorIndices(texels, color0, color1, indices);
+
+		for (int32 iteration = 0; quality == BlockCompressionQuality::QUALITY && iteration < 2 && error > 0; ++iteration)
+		{
+			uint16 refined0, refined1;
+			uint32 refinedIndices = 0;
+			if (!RefineEndpoints(texels, indices, refined0, refined1))
+				break;
+			const int32 refinedError = SelectColorIndices(texels, refined0, refined1, refinedIndices);
+			if (refinedError >= error)
+				break;
+			color0 = refined0;
+			color1 = refined1;
+			indices = refinedIndices;
+			error = refinedError;
+		}
+
+		out[0] = uint8(color0);
+		out[1] = uint8(color0 >> 8);
+		out[2] = uint8(color1);
+		out[3] = uint8(color1 >> 8);
+		for (int32 i = 0; i < 4; ++i)
+			out[4 + i] = uint8(indices >> (i * 8));
+	}
+
+	// eight values between the endpoints when alpha0 > alpha1, otherwise six values plus 0 and 255
+	void AlphaPalette(uint8 alpha0, uint8 alpha1, int32 palette[8])
+	{
+		palette[0] = alpha0;
+		palette[1] = alpha1;
+		if (alpha0 > alpha1)
+		{
+			for (int32 i = 1; i < 7; ++i)
+				palette[i + 1] = ((7 - i) * alpha0 + i * alpha1) / 7;
+		}
+		else
+		{
+			for (int32 i = 1; i < 5; ++i)
+				palette[i + 1] = ((5 - i) * alpha0 + i * alpha1) / 5;
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+	}
+
+	int32 SelectAlphaIndices(const FBlockTexels texels, uint8 alpha0, uint8 alpha1, uint64 &indices)
+	{
+		int32 palette[8];
+		AlphaPalette(alpha0, alpha1, palette);
+
+		indices = 0;
+		int32 error = 0;
+		for (int32 i = 0; i < 16; ++i)
+		{
+			const int32 alpha = texels[i * 4 + 3];
+			int32 best = 0, bestError = MAX_int32;
+			for (int32 p = 0; p < 8; ++p)
+			{
+				const int32 e = (alpha - palette[p]) * (alpha - palette[p]);
+				if (e < bestError)
+				{
+					bestError = e;
+					best = p;
+				}
+			}
+			indices |= uint64(best) << (i * 3);
+			error += bestError;
+		}
+		return error;
+	}
+
+	void EncodeAlphaBlock(const FBlockTexels texels, BlockCompressionQuality quality, uint8 *out)
+	{
+		uint8 minAlpha = 255, maxAlpha = 0;
+		uint8 minInner = 255, maxInner = 0;
+		for (int32 i = 0; i < 16; ++i)
+		{
+			const uint8 alpha = texels[i * 4 + 3];
+			minAlpha = FMath::Min(minAlpha, alpha);
+			maxAlpha = FMath::Max(maxAlpha, alpha);
+			if (alpha != 0 && alpha != 255)
+			{
+				minInner = FMath::Min(minInner, alpha);
+				maxInner = FMath::Max(maxInner, alpha);
+			}
+		}
+
+		uint8 alpha0 = maxAlpha, alpha1 = minAlpha;
+		uint64 indices = 0;
+		int32 error = SelectAlphaIndices(texels, alpha0, alpha1, indices);
+
+		// hair edges mix fully transparent and opaque texels with a few partial ones, the six value mode keeps 0 and 255 exact
+		if (quality == BlockCompressionQuality::QUALITY && error > 0)
+		{
+			if (minInner > maxInner)
+				minInner = maxInner = 0;
+			uint64 sixIndices = 0;
+			const int32 sixError = SelectAlphaIndices(texels, minInner, maxInner, sixIndices);
+			if (sixError < error)
+			{
+				alpha0 = minInner;
+				alpha1 = maxInner;
+				indices = sixIndices;
+			}
+		}
+
+		out[0] = alpha0;
+		out[1] = alpha1;
+		for (int32 i = 0; i < 6; ++i)
+			out[2 + i] = uint8(indices >> (i * 8));
+	}
+
+	void DecodeColorBlock(const uint8 *in, bool bFourColorsAlways, FBlockTexels texels)
+	{
+		const uint16 color0 = uint16(in[0] | (in[1] << 8)), color1 = uint16(in[2] | (in[3] << 8));
+		const uint32 indices = uint32(in[4]) | (uint32(in[5]) << 8) | (uint32(in[6]) << 16) | (uint32(in[7]) << 24);
+
+		int32 palette[4][3];
+		ColorPalette(color0, color1, palette);
+		bool bTransparent[4] = { false, false, false, false };
+		if (!bFourColorsAlways && color0 <= color1)
+		{
+			for (int32 c = 0; c < 3; ++c)
+			{
+				palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+				palette[3][c] = 0;
+			}
+			bTransparent[3] = true;
+		}
+
+		for (int32 i = 0; i < 16; ++i)
+		{
+			const int32 p = (indices >> (i * 2)) & 3;
+			uint8 *texel = texels + i * 4;
+			for (int32 c = 0; c < 3; ++c)
+				texel[c] = uint8(palette[p][c]);
+			texel[3] = bTransparent[p] ? 0 : 255;
+		}
+	}
+
+	void DecodeAlphaBlock(const uint8 *in, FBlockTexels texels)
+	{
+		int32 palette[8];
+		AlphaPalette(in[0], in[1], palette);
+		uint64 indices = 0;
+		for (int32 i = 0; i < 6; ++i)
+			indices |= uint64(in[2 + i]) << (i * 8);
+
+		for (int32 i = 0; i < 16; ++i)
+			texels[i * 4 + 3] = uint8(palette[(indices >> (i * 3)) & 7]);
+	}
+}
+
+BlockCompressionQuality ItSeez3D::TextureCompressionQuality()
+{
+	FString quality = TEXT("Quality");
+	if (GConfig)
+		GConfig->GetString(configSection, TEXT("TextureCompression"), quality, GGameIni);
+
+	if (quality.Equals(TEXT("None"), ESearchCase::IgnoreCase))
+		return BlockCompressionQuality::NONE;
+	if (quality.Equals(TEXT("Fast"), ESearchCase::IgnoreCase))
+		return BlockCompressionQuality::FAST;
+	return BlockCompressionQuality::QUALITY;
+}
+
+void ItSeez3D::CompressBlocks(const uint8 *bgra, int32 width, int32 height, EPixelFormat format, BlockCompressionQuality quality, TArray<uint8> &blocks)
+{
+	check(format == PF_DXT1 || format == PF_DXT5);
+	const bool bAlpha = format == PF_DXT5;
+	const int32 blockBytes = bAlpha ? 16 : 8;
+	const int32 blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+	blocks.SetNumUninitialized(blocksX * blocksY * blockBytes);
+
+	ParallelFor(blocksY, [&](int32 blockY)
+	{
+		FBlockTexels texels;
+		for (int32 blockX = 0; blockX < blocksX; ++blockX)
+		{
+			LoadBlock(bgra, width, height, blockX, blockY, texels);
+			uint8 *out = blocks.GetData() + (int64(blockY) * blocksX + blockX) * blockBytes;
+			if (bAlpha)
+			{
+				EncodeAlphaBlock(texels, quality, out);
+				out += 8;
+			}
+			EncodeColorBlock(texels, quality, out);
+		}
+	});
+}
+
+void ItSeez3D::DecompressBlocks(const uint8 *blocks, int32 width, int32 height, EPixelFormat format, TArray<uint8> &bgra)
+{
+	check(format == PF_DXT1 || format == PF_DXT5);
+	const bool bAlpha = format == PF_DXT5;
+	const int32 blockBytes = bAlpha ? 16 : 8;
+	const int32 blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+	bgra.SetNumUninitialized(width * height * 4);
+
+	ParallelFor(blocksY, [&](int32 blockY)
+	{
+		FBlockTexels texels;
+		for (int32 blockX = 0; blockX < blocksX; ++blockX)
+		{
+			const uint8 *in = blocks + (int64(blockY) * blocksX + blockX) * blockBytes;
+			DecodeColorBlock(bAlpha ? in + 8 : in, bAlpha, texels);
+			if (bAlpha)
+				DecodeAlphaBlock(in, texels);
+			StoreBlock(texels, width, height, blockX, blockY, bgra.GetData());
+		}
+	});
+}
+
+TArray<uint8> ItSeez3D::MakeBenchmarkTexture(int32 size)
+{
+	TArray<uint8> bgra;
+	bgra.SetNumUninitialized(size * size * 4);
+	FRandomStream random(size);
+	for (int32 y = 0; y < size; ++y)
+	{
+		for (int32 x = 0; x < size; ++x)
+		{
+			uint8 *texel = bgra.GetData() + (int64(y) * size + x) * 4;
+			const float detail = 12.0f * FMath::Sin(x * 0.21f) * FMath::Cos(y * 0.17f) + random.FRandRange(-4.0f, 4.0f);
+			texel[0] = uint8(FMath::Clamp(90.0f + 60.0f * y / size + detail, 0.0f, 255.0f));
+			texel[1] = uint8(FMath::Clamp(120.0f + 50.0f * x / size + detail, 0.0f, 255.0f));
+			texel[2] = uint8(FMath::Clamp(180.0f + 40.0f * (x + y) / (2 * size) + detail, 0.0f, 255.0f));
+			texel[3] = uint8(FMath::Clamp(128.0f + 2.0f * FMath::Sin(x * 0.05f) * (size / 2 - y), 0.0f, 255.0f));
+		}
+	}
+	return bgra;
+}
+
+namespace
+{
+	// peak signal to noise ratio over the color channels, or over alpha
+	double Psnr(const TArray<uint8> &original, const TArray<uint8> &decoded, bool bAlpha)
+	{
+		double squaredError = 0;
+		int64 samples = 0;
+		for (int32 i = 0; i < original.Num(); i += 4)
+		{
+			for (int32 c = bAlpha ? 3 : 0; c < (bAlpha ? 4 : 3); ++c)
+			{
+				const double d = double(original[i + c]) - decoded[i + c];
+				squaredError += d * d;
+				++samples;
+			}
+		}
+		const double mse = squaredError / FMath::Max<int64>(1, samples);
+		return mse > 0 ? 10.0 * FMath::LogX(10.0, 255.0 * 255.0 / mse) : 99.0;
+	}
+
+	void BenchmarkBlockCompressionCommand(const TArray<FString> &args)
+	{
+		const int32 size = args.Num() > 0 ? FMath::Max(4, FCString::Atoi(*args[0])) : 2048;
+		const int32 iterations = args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*args[1])) : 3;
+		const auto source = ItSeez3D::MakeBenchmarkTexture(size);
+		const double megabytes = source.Num() / (1024.0 * 1024.0);
+
+		for (const EPixelFormat format : { PF_DXT1, PF_DXT5 })
+		{
+			for (const BlockCompressionQuality quality : { BlockCompressionQuality::FAST, BlockCompressionQuality::QUALITY })
+			{
+				TArray<uint8> blocks;
+				const double startTime = FPlatformTime::Seconds();
+				for (int32 i = 0; i < iterations; ++i)
+					ItSeez3D::CompressBlocks(source.GetData(), size, size, format, quality, blocks);
+				const double seconds = (FPlatformTime::Seconds() - startTime) / iterations;
+
+				TArray<uint8> decoded;
+				ItSeez3D::DecompressBlocks(blocks.GetData(), size, size, format, decoded);
+				const FString alphaPsnr = format == PF_DXT5 ? FString::Printf(TEXT(", alpha PSNR %.2f dB"), Psnr(source, decoded, true)) : FString();
+				UE_LOG(LogAvatarSdk, Log, TEXT("%s %s of %dx%d texture: %.1f ms, %.1f MB/s, color PSNR %.2f dB%s"),
+					format == PF_DXT1 ? TEXT("BC1") : TEXT("BC3"), quality == BlockCompressionQuality::FAST ? TEXT("fast") : TEXT("quality"),
+					size, size, seconds * 1000.0, megabytes / seconds, Psnr(source, decoded, false), *alphaPsnr);
+			}
+		}
+	}
+
+	FAutoConsoleCommand benchmarkBlockCompressionCommand(
+		TEXT("AvatarSdk.BenchmarkBlockCompression"),
+		TEXT("Times BC1 and BC3 encoding of a synthetic texture and logs their PSNR. Usage: AvatarSdk.BenchmarkBlockCompression [size] [iterations]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&BenchmarkBlockCompressionCommand)
+	);
+}
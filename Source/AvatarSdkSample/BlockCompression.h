@@ -0,0 +1,40 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PixelFormat.h"
+
+
+namespace ItSeez3D
+{
+	/// TextureCompression in the game config: "None", "Fast" (bounding box endpoints) or "Quality" (principal
+	/// axis endpoints refined by least squares, and the second alpha mode of BC3 tried as well).
+	enum class BlockCompressionQuality
+	{
+		NONE,
+		FAST,
+		QUALITY,
+	};
+
+	BlockCompressionQuality TextureCompressionQuality();
+
+	/// Encodes BGRA8 into PF_DXT1 (BC1, alpha dropped) or PF_DXT5 (BC3) blocks, rows of blocks in parallel.
+	/// Blocks past the image edge repeat the edge texels.
+	void CompressBlocks(const uint8 *bgra, int32 width, int32 height, EPixelFormat format, BlockCompressionQuality quality, TArray<uint8> &blocks);
+
+	/// Decodes the blocks back to BGRA8, used to measure the compression error.
+	void DecompressBlocks(const uint8 *blocks, int32 width, int32 height, EPixelFormat format, TArray<uint8> &bgra);
+
+	/// Synthetic BGRA8 square for the texture benchmark commands: skin-like gradients with fine detail and a soft
+	/// alpha edge like the hair texture. The same size always gives the same texels.
+	TArray<uint8> MakeBenchmarkTexture(int32 size);
+}
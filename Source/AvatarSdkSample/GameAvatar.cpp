@@ -12,261 +12,116 @@
 #include "GameAvatar.h"
 
 #include <map>
-#include <vector>
-#include <fstream>
-#include <sstream>
-
-#if PLATFORM_IOS
-	#import <Foundation/Foundation.h>
-#endif
 
+#include "Paths.h"
 #include "TimerManager.h"
 #include "EngineGlobals.h"
 #include "ModuleManager.h"
 #include "ProceduralMeshComponent.h"
 
+#include "Async/Async.h"
+#include "Misc/ConfigCacheIni.h"
+
 #include <Runtime/Engine/Classes/Engine/Engine.h>
 #include "Runtime/Engine/Classes/Engine/Texture2D.h"
 #include "Runtime/Engine/Classes/Materials/MaterialInterface.h"
 #include "Runtime/Engine/Classes/Materials/MaterialInstanceDynamic.h"
 
 #include "Runtime/ImageWrapper/Public/Interfaces/IImageWrapper.h"
-#include "Runtime/ImageWrapper/Public/Interfaces/IImageWrapperModule.h"
 
 #include "Runtime/Json/Public/Json.h"
 #include "Runtime/JsonUtilities/Public/JsonUtilities.h"
 
+#include "AssetCache.h"
+#include "AsyncFileIO.h"
+#include "AuthSession.h"
+#include "AvatarSdkSample.h"
+#include "AvatarTexture.h"
+#include "AvatarStatusPoller.h"
+#include "HaircutAssets.h"
+#include "HaircutPrefetcher.h"
+#include "HttpCache.h"
+#include "HttpRecordReplay.h"
+#include "PhotoIndex.h"
+#include "PhotoPreprocessor.h"
+#include "PipelineCheckpoint.h"
+#include "RangedDownloader.h"
 #include "Ply.h"
-#include "ZipUtils.h"
 
 
 namespace
 {
-	const char *clientId = "";
-	const char *clientSecret = "";
-
-	void SaveTArray(const TArray<uint8> &arr, const FString &filename)
-	{
-		const std::string path{ TCHAR_TO_UTF8(*filename) };
-		std::ofstream f{ path, std::ios::out | std::ios::binary };
-		f.write((const char *)arr.GetData(), arr.Num());
-	}
-
-	/// Returns number of bytes read.
-	size_t LoadTArray(const FString &filename, TArray<uint8> &arr)
-	{
-		const std::string path{ TCHAR_TO_UTF8(*filename) };
-		std::ifstream stream{ path, std::ios::in | std::ios::binary };
-
-		stream.seekg(0, std::ios::end);
-		const auto size = stream.tellg();
-		stream.seekg(0);
-		arr.SetNum(size);
-		if (stream.read((char *)arr.GetData(), size))
-			return size;
-		else
-			return 0;
-	}
-
-	FString EnsureDirectoryExists(const FString &dir)
-	{
-#if PLATFORM_IOS
-		const char *locationUTF8 = TCHAR_TO_UTF8(*dir);
-		NSString *dataPath = [NSString stringWithUTF8String : locationUTF8];
-
-		if (![[NSFileManager defaultManager] fileExistsAtPath:dataPath])
-			[[NSFileManager defaultManager] createDirectoryAtPath:dataPath withIntermediateDirectories : YES attributes : nil error : nil];
-#else
-		auto &platformFile = FPlatformFileManager::Get().GetPlatformFile();
-		if (!platformFile.DirectoryExists(*dir))
-			platformFile.CreateDirectory(*dir);
-#endif
-		return dir;
-	}
-
-	FString DownloadLocation()
-	{
-#if PLATFORM_IOS
-		NSArray *paths = NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES);
-		NSString *documentsDirectory = [paths objectAtIndex : 0];
-		const char *docPath = [documentsDirectory UTF8String];
-		const auto location = FString(UTF8_TO_TCHAR(docPath));
-#else
-		const auto location = FPaths::GamePersistentDownloadDir();
-#endif
-		return location;
-	}
-
-	FString DownloadLocation(const FString &avatarCode)
-	{
-		const auto location = FPaths::Combine(DownloadLocation(), avatarCode);
-		return EnsureDirectoryExists(location);
-	}
-
-	FString HaircutDownloadLocation()
-	{
-		const auto location = FPaths::Combine(DownloadLocation(), TEXT("haircuts"));
-		return EnsureDirectoryExists(location);
-	}
+	using namespace ItSeez3D;
 
 	enum class AvatarFile
 	{
-		HAIRCUT_POINTS_ZIP,
 		HAIRCUT_POINTS_PLY,
 	};
 
-	enum class HaircutFile
-	{
-		MESH_ZIP,
-		MESH,
-		TEXTURE,
-	};
-
-	FString HaircutFilePath(HaircutFile file, const FString &haircutId)
-	{
-		static const std::map<HaircutFile, FString> ext =
-		{
-			{ HaircutFile::MESH_ZIP, TEXT("zip") },
-			{ HaircutFile::MESH, TEXT("ply") },
-			{ HaircutFile::TEXTURE, TEXT("png") },
-		};
-		const auto fname = FString::Printf(TEXT("%s.%s"), *haircutId, *ext.at(file));
-		return FPaths::Combine(HaircutDownloadLocation(), fname);
-	}
-
-	FString HaircutAvatarFilePath(AvatarFile file, const FString &avatar, const FString &haircutId)
+	FString HaircutAvatarAssetName(AvatarFile file, const FString &avatar, const FString &haircutId)
 	{
 		static const std::map<AvatarFile, FString> names =
 		{
-			{ AvatarFile::HAIRCUT_POINTS_ZIP, TEXT("cloud_%s.zip") },
 			{ AvatarFile::HAIRCUT_POINTS_PLY, TEXT("cloud_%s.ply") },
 		};
-		const auto fname = FString::Printf(*names.at(file), *haircutId);
-		return FPaths::Combine(DownloadLocation(avatar), fname);
+		return AvatarAssetName(avatar, FString::Printf(*names.at(file), *haircutId));
 	}
 
-	FString GetRootUrl()
+	// form fields sent with the photo, part of the photo key in the PhotoIndex
+	const TMap<FString, FString> & AvatarParameters()
 	{
-		return "https://avatar-api.itseez3d.com";
-	}
-
-	FString Join(const FString &token)
-	{
-		return token;
+		static const TMap<FString, FString> parameters =
+		{
+			{ TEXT("name"), TEXT("test_avatar_unreal") },
+			{ TEXT("description"), TEXT("test_description_unreal") },
+		};
+		return parameters;
 	}
 
-	template<typename... Args>
-	FString Join(const FString &token, Args... tokens)
-	{
-		return token + "/" + Join(std::forward<Args>(tokens)...);
-	}
+	// damaged cache entries downloaded again per actor, more means the disk keeps corrupting them
+	const int32 maxDamagedAssetRefetches = 3;
 
-	template<typename... Args>
-	FString Url(Args... tokens)
+	bool IsWarmStartEnabled()
 	{
-		return Join(GetRootUrl(), std::forward<Args>(tokens)...) + "/";
+		bool bWarmStart = false;
+		if (GConfig)
+			GConfig->GetBool(configSection, TEXT("WarmStart"), bWarmStart, GGameIni);
+		return bWarmStart;
 	}
 
-	bool IsHttpCodeGood(int code)
+	// the last cold and warm start times are kept across runs, so both are logged side by side
+	void ReportTimeToFirstAvatar(bool bWarmStart, double seconds)
 	{
-		return code >= 200 && code < 400;
+		const FString path = FPaths::Combine(DownloadLocation(), TEXT("startup_times.json"));
+		LoadFileAsync(path, [path, bWarmStart, seconds](const FFileBytes &bytes)
+		{
+			TSharedPtr<FJsonObject> json;
+			if (bytes.IsValid())
+			{
+				const FUTF8ToTCHAR converted((const ANSICHAR *)bytes->GetData(), bytes->Num());
+				auto reader = TJsonReaderFactory<>::Create(FString(converted.Length(), converted.Get()));
+				FJsonSerializer::Deserialize(reader, json);
+			}
+			if (!json.IsValid())
+				json = MakeShareable(new FJsonObject());
+			json->SetNumberField(bWarmStart ? "warm" : "cold", seconds);
+
+			double cold = 0, warm = 0;
+			json->TryGetNumberField("cold", cold);
+			json->TryGetNumberField("warm", warm);
+			UE_LOG(LogAvatarSdk, Log, TEXT("Time to first avatar %.2f s, %s start. Last cold start %.2f s, last warm start %.2f s"),
+				seconds, bWarmStart ? TEXT("warm") : TEXT("cold"), cold, warm);
+
+			FString text;
+			auto writer = TJsonWriterFactory<>::Create(&text);
+			FJsonSerializer::Serialize(json.ToSharedRef(), writer);
+			const FTCHARToUTF8 utf8(*text);
+			TArray<uint8> content((const uint8 *)utf8.Get(), utf8.Length());
+			SaveFileAsync(path, MoveTemp(content));
+		});
 	}
 }
 
-struct AvatarData
-{
-	AvatarData(const FJsonObject &json)
-	{
-		code = json.GetStringField("code");
-		status = json.GetStringField("status");
-		json.TryGetStringField("mesh", mesh);
-		json.TryGetStringField("texture", texture);
-		json.TryGetStringField("haircuts", haircuts);
-		progress = json.GetIntegerField("progress");
-	}
-
-	FString code, status;
-	FString mesh, texture, haircuts;
-	int progress;
-};
-
-struct HaircutData
-{
-	HaircutData(const FJsonObject &json)
-	{
-		id = json.GetStringField("identity");
-		json.TryGetStringField("mesh", mesh);
-		json.TryGetStringField("texture", texture);
-		json.TryGetStringField("pointcloud", pointCloud);
-	}
-
-	FString id;
-	FString mesh, texture, pointCloud;
-};
-
-// multipart form utils
-class MultipartRequestBody
-{
-public:
-	MultipartRequestBody()
-	{
-		// generate multipart form boundary
-		const auto guid = FGuid::NewGuid().ToString();
-		boundary = std::string(TCHAR_TO_UTF8(*guid));
-		separator = "\r\n--" + boundary + "\r\n";
-	}
-
-	~MultipartRequestBody()
-	{
-		LogBody();
-	}
-
-	void TextField(const std::string &name, const std::string &value)
-	{
-		body << separator;
-		body << "Content-Disposition: form-data; name=\"" << name << "\"\r\n";
-		body << "Content-Type: text/plain; encoding=utf-8\r\n\r\n";
-		body << value;
-	}
-
-	void FileField(const std::string &name, const std::string &filename, const char *data, size_t size)
-	{
-		body << separator;
-		body << "Content-Disposition: file; name=\"" << name << "\"; ";
-		body << "filename=\"" << filename << "\"\r\n";
-		body << "Content-Type: application/octet-stream\r\n\r\n";
-		body.write(data, size);
-	}
-
-	void Footer()
-	{
-		body << "\r\n--" << boundary << "--\r\n";
-	}
-
-	TSharedRef<TArray<uint8>> GetBody() const
-	{
-		TSharedRef<TArray<uint8>> content{ new TArray<uint8>() };
-		const auto bodyStr = body.str();
-		content->Append((const uint8 *)bodyStr.c_str(), bodyStr.length());
-		return content;
-	}
-
-	FString GetContentType() const
-	{
-		return "multipart/form-data; boundary=\"" + FString(UTF8_TO_TCHAR(boundary.c_str())) + "\"";
-	}
-
-	void LogBody() const
-	{
-		const FString bodyStr = UTF8_TO_TCHAR(body.str().c_str());
-		UE_LOG(LogClass, Log, TEXT("content %s"), *bodyStr);
-	}
-
-private:
-	std::string boundary, separator;
-	std::ostringstream body;
-};
-
 
 // Sets default values
 AGameAvatar::AGameAvatar()
@@ -274,8 +129,6 @@ AGameAvatar::AGameAvatar()
  	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
 	PrimaryActorTick.bCanEverTick = true;
 
-	http = &FHttpModule::Get();
-
 	avatarComponent = CreateDefaultSubobject<USceneComponent>(TEXT("Avatar"));
 	RootComponent = avatarComponent;
 
@@ -289,493 +142,603 @@ AGameAvatar::AGameAvatar()
 void AGameAvatar::BeginPlay()
 {
 	Super::BeginPlay();
+
+	// the cache index is read here, so later asset lookups don't touch the file system
+	AssetCache::Get();
 }
 
 void AGameAvatar::GenerateAvatar()
 {
-	UE_LOG(LogClass, Log, TEXT("Starting..."));
+	UE_LOG(LogAvatarSdk, Log, TEXT("Starting..."));
 	GEngine->AddOnScreenDebugMessage(-1, 5.f, FColor::Green, FString::Printf(TEXT("Starting!")));
-	Authorize();
-}
-
-void AGameAvatar::SetCommonHeaders(const TSharedRef<IHttpRequest> &req) const
-{
-	req->SetHeader("User-Agent", "X-UnrealEngineAvatarPlugin-Agent");
-	if (!accessToken.IsEmpty())
-		req->SetHeader("Authorization", tokenType + " " + accessToken);
-	if (!playerUID.IsEmpty())
-		req->SetHeader("X-PlayerUID", playerUID);
-}
-
-TSharedRef<IHttpRequest> AGameAvatar::GetRequest(const FString &url)
-{
-	UE_LOG(LogClass, Log, TEXT("Url %s"), *url);
-	auto req = http->CreateRequest();
-	req->SetURL(url);
-	req->SetVerb("GET");
-	SetCommonHeaders(req);
-	return req;
-}
+	startTime = FPlatformTime::Seconds();
+	// an unfinished avatar from the last run is resumed rather than replaced by a cached one
+	if (IsWarmStartEnabled() && !PipelineCheckpoint::Get().PendingAvatar().IsValid() && StartFromCache())
+		return;
 
-TSharedRef<IHttpRequest> AGameAvatar::PostRequest(const FString &url, MultipartRequestBody &form)
-{
-	UE_LOG(LogClass, Log, TEXT("Url %s"), *url);
-	auto req = http->CreateRequest();
-	req->SetURL(url);
-	req->SetVerb("POST");
-	req->SetContent(form.GetBody().Get());
-	req->SetHeader("Content-Type", form.GetContentType());
-	SetCommonHeaders(req);
-	return req;
+	GEngine->AddOnScreenDebugMessage(-1, 5.f, FColor::Green, FString::Printf(TEXT("Authorizing...")));
+	AuthSession::Get().Acquire(FOnCredentialsReady::CreateUObject(this, &AGameAvatar::OnCredentialsReady));
 }
 
-bool AGameAvatar::HandleResponse(FHttpResponsePtr response, bool bWasSuccessful)
+bool AGameAvatar::StartFromCache()
 {
-	const auto responseContent = response->GetContentAsString();
-	const auto code = response->GetResponseCode();
-	UE_LOG(LogClass, Log, TEXT("Request completed. good: %d, Content: %s, Code: %d"), int(bWasSuccessful), *responseContent, code);
-
-	if (!bWasSuccessful || !IsHttpCodeGood(code))
+	const FString prefix = TEXT("avatars/"), meshFile = TEXT("/model.ply");
+	for (const auto &name : AssetCache::Get().NamesByRecentUse(prefix))
 	{
-		UE_LOG(LogClass, Error, TEXT("Request was not successful"));
-		return false;
-	}
+		if (!name.EndsWith(meshFile))
+			continue;
 
-	return true;
-}
-
-TSharedPtr<FJsonObject> AGameAvatar::HandleJsonResponse(FHttpResponsePtr response, bool bWasSuccessful)
-{
-	TSharedPtr<FJsonObject> data;
+		const FString code = name.RightChop(prefix.Len()).LeftChop(meshFile.Len());
+		if (code.IsEmpty() || !AssetCache::Get().Contains(AvatarAssetName(code, TEXT("model.jpg"))))
+			continue;
 
-	if (!HandleResponse(response, bWasSuccessful))
-		return data;
+		UE_LOG(LogAvatarSdk, Log, TEXT("Warm start with cached avatar %s"), *code);
+		GEngine->AddOnScreenDebugMessage(-1, 5.f, FColor::Green, FString::Printf(TEXT("Loading cached avatar...")));
+		bWarmStart = true;
+		currAvatar = MakeShareable(new AvatarData());
+		currAvatar->code = code;
+		currAvatar->status = TEXT("Completed");
+		meshPath = AssetCache::Get().Find(name);
+		texturePath = AssetCache::Get().Find(AvatarAssetName(code, TEXT("model.jpg")));
+		DisplayAvatar();
 
-	auto jsonReader = TJsonReaderFactory<>::Create(response->GetContentAsString());
-	if (FJsonSerializer::Deserialize(jsonReader, data))
-		return data;
-	else
-	{
-		UE_LOG(LogClass, Error, TEXT("Json parsing failed!"));
-		return TSharedPtr<FJsonObject>();
+		const auto haircut = PipelineCheckpoint::Get().ChosenHaircut(code);
+		if (haircut.IsValid() && IsHaircutAssetAvailable(HaircutFile::MESH, haircut->id) && IsHaircutAssetAvailable(HaircutFile::TEXTURE, haircut->id) &&
+			AssetCache::Get().Contains(HaircutAvatarAssetName(AvatarFile::HAIRCUT_POINTS_PLY, code, haircut->id)))
+		{
+			currHaircut = haircut;
+			haircutMeshDownloaded = haircutTextureDownloaded = haircutPointsDownloaded = true;
+			DisplayHaircut();
+		}
+		return true;
 	}
-}
 
-TSharedPtr<FJsonValue> AGameAvatar::HandleJsonArrayResponse(FHttpResponsePtr response, bool bWasSuccessful)
-{
-	TSharedPtr<FJsonValue> data;
-	if (!HandleResponse(response, bWasSuccessful))
-		return data;
-	
-	auto jsonReader = TJsonReaderFactory<>::Create(response->GetContentAsString());
-	if (FJsonSerializer::Deserialize(jsonReader, data))
-		return data;
-	else
-	{
-		UE_LOG(LogClass, Error, TEXT("Json array parsing failed!"));
-		return TSharedPtr<FJsonValue>();
-	}
+	UE_LOG(LogAvatarSdk, Log, TEXT("No cached avatars, generating a new one"));
+	return false;
 }
 
-const TArray<uint8> & AGameAvatar::HandleDataResponse(FHttpResponsePtr response, bool bWasSuccessful, bool &bIsOk)
+void AGameAvatar::OnCredentialsReady(bool bSucceeded, const Credentials &sessionCredentials)
 {
-	const auto code = response->GetResponseCode();
-	UE_LOG(LogClass, Log, TEXT("Request completed. good: %d, Code: %d"), int(bWasSuccessful), code);
-
-	bIsOk = true;
-	if (!bWasSuccessful || !IsHttpCodeGood(code))
+	if (!bSucceeded)
 	{
-		UE_LOG(LogClass, Error, TEXT("Data request was not successful"));
-		bIsOk = false;
-	}
-
-	return response->GetContent();
-}
-
-void AGameAvatar::Authorize()
-{
-	MultipartRequestBody form;
-	form.TextField("grant_type", "client_credentials");
-	form.TextField("client_id", clientId);
-	form.TextField("client_secret", clientSecret);
-	form.Footer();
-
-	auto request = PostRequest(Url("o", "token"), form);
-	request->OnProcessRequestComplete().BindUObject(this, &AGameAvatar::OnAuthorizationCompleted);
-	request->ProcessRequest();
-}
-
-void AGameAvatar::OnAuthorizationCompleted(FHttpRequestPtr req, FHttpResponsePtr response, bool bWasSuccessful)
-{
-	const auto credentials = HandleJsonResponse(response, bWasSuccessful);
-	if (!credentials.IsValid())
+		UE_LOG(LogAvatarSdk, Error, TEXT("Authorization failed"));
 		return;
+	}
 
-	tokenType = credentials->GetStringField("token_type");
-	accessToken = credentials->GetStringField("access_token");
-	UE_LOG(LogClass, Log, TEXT("Auth: %s  --  %s"), *tokenType, *accessToken);
-
-	RegisterPlayer();
-}
-
-void AGameAvatar::RegisterPlayer()
-{
-	MultipartRequestBody form;
-	form.TextField("comment", "test_unreal_player");
-	form.Footer();
-
-	GEngine->AddOnScreenDebugMessage(-1, 5.f, FColor::Green, FString::Printf(TEXT("Authorizing...")));
-	auto request = PostRequest(Url("players"), form);
-	request->OnProcessRequestComplete().BindUObject(this, &AGameAvatar::OnPlayerRegistered);
-	request->ProcessRequest();
-}
-
-void AGameAvatar::OnPlayerRegistered(FHttpRequestPtr request, FHttpResponsePtr response, bool bWasSuccessful)
-{
-	auto playerResponse = HandleJsonResponse(response, bWasSuccessful);
-	if (!playerResponse.IsValid())
+	const auto pendingAvatar = PipelineCheckpoint::Get().PendingAvatar();
+	if (pendingAvatar.IsValid())
+	{
+		UE_LOG(LogAvatarSdk, Log, TEXT("Resuming avatar %s from the last run, status %s"), *pendingAvatar->code, *pendingAvatar->status);
+		GEngine->AddOnScreenDebugMessage(-1, 5.f, FColor::Green, FString::Printf(TEXT("Resuming avatar...")));
+		currAvatar = pendingAvatar;
+		CheckAvatarStatus();
 		return;
+	}
 
-	playerUID = playerResponse->GetStringField("code");
-
-	// use CreateAvatarWithPhotoFilesystem to provide photo as a local file
+	// use CreateAvatarWithPhotoFilesystem to provide photo as a local file, e.g.
+	// CreateAvatarWithPhotoFilesystem(TEXT(R"(C:\Users\objscan\Pictures\selfies\test_selfie.jpg)"));
 	CreateAvatarWithPhotoFromWeb(TEXT("https://s3.amazonaws.com/itseez3d-unreal/test_selfie.jpg"));
 }
 
 void AGameAvatar::CreateAvatarWithPhotoFromWeb(const FString &url)
 {
-	UE_LOG(LogClass, Log, TEXT("photo url %s"), *url);
-	auto photoRequest = http->CreateRequest();
+	UE_LOG(LogAvatarSdk, Log, TEXT("photo url %s"), *url);
+	auto photoRequest = ItSeez3D::CreateHttpRequest();
 	photoRequest->SetURL(url);
 	photoRequest->SetVerb("GET");
 
-	photoRequest->OnProcessRequestComplete().BindLambda([&](FHttpRequestPtr, FHttpResponsePtr response, bool bWasSuccessful)
+	TWeakObjectPtr<AGameAvatar> weakThis(this);
+	photoRequest->OnProcessRequestComplete().BindLambda([weakThis](FHttpRequestPtr, FHttpResponsePtr response, bool bWasSuccessful)
 	{
 		bool bIsOk;
-		auto photoBytes = HandleDataResponse(response, bWasSuccessful, bIsOk);
+		HandleDataResponse(response, bWasSuccessful, bIsOk);
 		if (!bIsOk)
 			return;
 
-		MultipartRequestBody form;
-		form.TextField("name", "test_avatar_unreal");
-		form.TextField("description", "test_description_unreal");
-
-		form.FileField("photo", "photo.jpg", (const char*)photoBytes.GetData(), photoBytes.Num());
-		form.Footer();
-
-		auto avatarRequest = PostRequest(Url("avatars"), form);
-		avatarRequest->OnProcessRequestComplete().BindUObject(this, &AGameAvatar::OnPhotoUploaded);
-		avatarRequest->ProcessRequest();
+		PreprocessPhotoAsync(response, [weakThis](const uint8 *data, int64 size, const FString &photoKey)
+		{
+			if (weakThis.IsValid())
+				weakThis->UploadPhoto(data, size, photoKey);
+		}, &AvatarParameters());
 	});
-	UE_LOG(LogClass, Log, TEXT("Downloading photo from web"));
+	UE_LOG(LogAvatarSdk, Log, TEXT("Downloading photo from web"));
 	GEngine->AddOnScreenDebugMessage(-1, 5.f, FColor::Green, FString::Printf(TEXT("Getting photo...")));
 	photoRequest->ProcessRequest();
 }
 
-void AGameAvatar::CreateAvatarWithPhotoFilesystem()
+void AGameAvatar::CreateAvatarWithPhotoFilesystem(const FString &photoPath)
 {
-	MultipartRequestBody form;
-	form.TextField("name", "test_avatar_unreal");
-	form.TextField("description", "test_description_unreal");
+	// the file is read on a worker thread even without preprocessing, the photo key needs its bytes
+	TWeakObjectPtr<AGameAvatar> weakThis(this);
+	PreprocessPhotoAsync(photoPath, [weakThis](const uint8 *data, int64 size, const FString &photoKey)
+	{
+		if (weakThis.IsValid())
+			weakThis->UploadPhoto(data, size, photoKey);
+	}, &AvatarParameters());
+}
+
+void AGameAvatar::UploadPhoto(const uint8 *data, int64 size, const FString &photoKey)
+{
+	if (size <= 0)
+	{
+		UE_LOG(LogAvatarSdk, Error, TEXT("No photo to upload"));
+		return;
+	}
+
+	const FString knownCode = PhotoIndex::Get().FindAvatar(photoKey);
+	if (!knownCode.IsEmpty())
+	{
+		UE_LOG(LogAvatarSdk, Log, TEXT("Avatar %s was generated from this photo before, skipping the upload"), *knownCode);
+		GEngine->AddOnScreenDebugMessage(-1, 5.f, FColor::Green, FString::Printf(TEXT("Photo seen before, reusing its avatar!")));
+		reusedPhoto = TArray<uint8>(data, int32(size));
+		reusedPhotoKey = photoKey;
+		currAvatar = MakeShareable(new AvatarData());
+		currAvatar->code = knownCode;
+		PipelineCheckpoint::Get().SaveAvatar(*currAvatar);
+		CheckAvatarStatus();
+		return;
+	}
+
+	reusedPhoto.Empty();
+	reusedPhotoKey.Empty();
 
-	std::ifstream photoFile{ R"(C:\Users\objscan\Pictures\selfies\test_selfie.jpg)", std::ios::in | std::ios::binary };
-	std::vector<char> photoBytes{ std::istreambuf_iterator<char>(photoFile), std::istreambuf_iterator<char>() };
-	form.FileField("photo", "photo.jpg", photoBytes.data(), photoBytes.size());
+	MultipartRequestBody form;
+	for (const auto &parameter : AvatarParameters())
+		form.TextField(TCHAR_TO_UTF8(*parameter.Key), TCHAR_TO_UTF8(*parameter.Value));
+	form.FileField("photo", "photo.jpg", (const char *)data, size);
 	form.Footer();
 
-	auto request = PostRequest(Url("avatars"), form);
-	request->OnProcessRequestComplete().BindUObject(this, &AGameAvatar::OnPhotoUploaded);
 	GEngine->AddOnScreenDebugMessage(-1, 5.f, FColor::Green, FString::Printf(TEXT("Uploading photo to server...")));
-	request->ProcessRequest();
+	TWeakObjectPtr<AGameAvatar> weakThis(this);
+	SendAuthorized(PostRequest(Url("avatars"), form, AuthSession::Get().GetCredentials()), [weakThis, photoKey](FHttpResponsePtr response, bool bWasSuccessful)
+	{
+		if (weakThis.IsValid())
+			weakThis->OnPhotoUploaded(response, bWasSuccessful, photoKey);
+	});
 }
 
-void AGameAvatar::OnPhotoUploaded(FHttpRequestPtr request, FHttpResponsePtr response, bool bWasSuccessful)
+void AGameAvatar::OnPhotoUploaded(FHttpResponsePtr response, bool bWasSuccessful, const FString &photoKey)
 {
-	auto avatarResponse = HandleJsonResponse(response, bWasSuccessful);
-	if (!avatarResponse.IsValid())
+	auto avatar = HandleAvatarResponse(response, bWasSuccessful);
+	if (!avatar.IsValid())
 		return;
 
 	GEngine->AddOnScreenDebugMessage(-1, 5.f, FColor::Green, FString::Printf(TEXT("Photo uploaded!")));
-	currAvatar = MakeShareable(new AvatarData(*avatarResponse));
-	GetWorldTimerManager().SetTimer(awaitTimer, this, &AGameAvatar::CheckAvatarStatus, 4.0f, false);
+	currAvatar = avatar;
+	PipelineCheckpoint::Get().SaveAvatar(*currAvatar);
+	PhotoIndex::Get().Add(photoKey, currAvatar->code);
+
+	CheckAvatarStatus();
 }
 
 void AGameAvatar::CheckAvatarStatus()
 {
-	auto request = GetRequest(Url("avatars", currAvatar->code));
-	request->OnProcessRequestComplete().BindUObject(this, &AGameAvatar::OnAvatarStatusRequested);
-
-	UE_LOG(LogClass, Log, TEXT("Updating status for avatar: %s"), *(currAvatar->code));
-	request->ProcessRequest();
+	UE_LOG(LogAvatarSdk, Log, TEXT("Waiting for avatar: %s"), *(currAvatar->code));
+	AvatarStatusPoller::Get().Track(*currAvatar, FOnAvatarStatus::CreateUObject(this, &AGameAvatar::OnAvatarStatusUpdated));
 }
 
-void AGameAvatar::OnAvatarStatusRequested(FHttpRequestPtr request, FHttpResponsePtr response, bool bWasSuccessful)
+void AGameAvatar::OnAvatarStatusUpdated(TSharedPtr<AvatarData> avatar)
 {
-	auto avatarResponse = HandleJsonResponse(response, bWasSuccessful);
-	if (!avatarResponse.IsValid())
+	if (!avatar.IsValid())
+	{
+		// the avatar may still be computed, the next launch resumes it from the checkpoint
+		UE_LOG(LogAvatarSdk, Error, TEXT("Unable to get status of avatar: %s"), *(currAvatar->code));
 		return;
+	}
 
+	currAvatar = avatar;
 	GEngine->AddOnScreenDebugMessage(-1, 13.f, FColor::Green, FString::Printf(TEXT("Avatar calculation status: %s, progress: %d"), *(currAvatar->status), currAvatar->progress));
 
-	currAvatar = MakeShareable(new AvatarData(*avatarResponse.Get()));
-	if (currAvatar->status == "Failed" || currAvatar->status == "Timed Out")
+	if (currAvatar->status == "Failed" || currAvatar->status == "Timed Out" || currAvatar->status == "Not Found")
 	{
-		UE_LOG(LogClass, Warning, TEXT("Avatar calculations failed with status: %s"), *currAvatar->status);
+		UE_LOG(LogAvatarSdk, Warning, TEXT("Avatar calculations failed with status: %s"), *currAvatar->status);
+		PipelineCheckpoint::Get().Clear();
+		PhotoIndex::Get().RemoveAvatar(currAvatar->code);
+
+		const TArray<uint8> photo = MoveTemp(reusedPhoto);
+		const FString photoKey = MoveTemp(reusedPhotoKey);
+		if (currAvatar->status == "Not Found" && photo.Num() > 0)
+		{
+			UE_LOG(LogAvatarSdk, Log, TEXT("Reused avatar %s is gone, uploading its photo again"), *currAvatar->code);
+			UploadPhoto(photo.GetData(), photo.Num(), photoKey);
+		}
 		return;
 	}
 
 	if (currAvatar->status == "Completed")
 	{
-		UE_LOG(LogClass, Log, TEXT("Avatar calculations finished with status: %s"), *currAvatar->status);
+		reusedPhoto.Empty();
+		reusedPhotoKey.Empty();
+		UE_LOG(LogAvatarSdk, Log, TEXT("Avatar calculations finished with status: %s"), *currAvatar->status);
+		PipelineCheckpoint::Get().SaveAvatar(*currAvatar);
+		bMeasuringLoad = true;
+		loadStartTime = FPlatformTime::Seconds();
+		worstLoadFrame = 0;
+		loadFrames = 0;
 		DownloadHeadMesh();
 		DownloadHeadTexture();
 		GetHaircuts();
-		return;
 	}
-
-	GetWorldTimerManager().SetTimer(awaitTimer, this, &AGameAvatar::CheckAvatarStatus, 4.0f, false);
 }
 
 void AGameAvatar::DownloadHeadMesh()
 {
-	auto request = GetRequest(currAvatar->mesh);
-	request->OnProcessRequestComplete().BindLambda([&](FHttpRequestPtr req, FHttpResponsePtr response, bool bWasSuccessful)
+	const auto meshName = AvatarAssetName(currAvatar->code, TEXT("model.ply"));
+	if (AssetCache::Get().Contains(meshName))
 	{
-		bool bIsOk;
-		auto meshResponse = HandleDataResponse(response, bWasSuccessful, bIsOk);
-		if (!bIsOk)
+		UE_LOG(LogAvatarSdk, Log, TEXT("Mesh for avatar %s already downloaded!"), *currAvatar->code);
+		meshPath = AssetCache::Get().Find(meshName);
+		DisplayAvatar();
+		return;
+	}
+
+	// the archive is cached even if the actor is gone by then
+	TWeakObjectPtr<AGameAvatar> weakThis(this);
+	const FString code = currAvatar->code, url = currAvatar->mesh;
+	const auto onDownloaded = FOnAssetDownloaded::CreateLambda([weakThis, meshName, code, url](bool bSucceeded, const FFileBytes &meshResponse)
+	{
+		if (!bSucceeded)
 			return;
-		
-		const auto meshArchivePath = FPaths::Combine(DownloadLocation(currAvatar->code), TEXT("model.zip"));
-		SaveTArray(meshResponse, meshArchivePath);
 
-		if (ItSeez3D::UnzipFile(meshArchivePath))
+		AssetCache::Get().PutArchive(AvatarAssetName(code, FString()), meshResponse, [weakThis, meshName, url](bool bStored)
 		{
-			UE_LOG(LogClass, Log, TEXT("Unzip completed for mesh archive!"));
-			meshPath = FPaths::Combine(DownloadLocation(currAvatar->code), TEXT("model.ply"));
-			DisplayAvatar();
-		}
+			if (!bStored)
+				return;
+
+			UE_LOG(LogAvatarSdk, Log, TEXT("Unzip completed for mesh archive!"));
+			HttpCache::Get().Remove(url);
+			if (weakThis.IsValid())
+			{
+				weakThis->meshPath = AssetCache::Get().Find(meshName);
+				weakThis->DisplayAvatar();
+			}
+		});
 	});
-	UE_LOG(LogClass, Log, TEXT("Downloading mesh for avatar: %s"), *currAvatar->code);
+	UE_LOG(LogAvatarSdk, Log, TEXT("Downloading mesh for avatar: %s"), *currAvatar->code);
 	GEngine->AddOnScreenDebugMessage(-1, 5.f, FColor::Green, FString::Printf(TEXT("Downloading mesh...")));
-	request->ProcessRequest();
+	RangedDownloader::Download(currAvatar->mesh, AssetCache::Get().PartPath(AvatarAssetName(currAvatar->code, TEXT("model.zip"))), onDownloaded);
 }
 
 void AGameAvatar::DownloadHeadTexture()
 {
-	auto request = GetRequest(currAvatar->texture);
-	request->OnProcessRequestComplete().BindLambda([&](FHttpRequestPtr req, FHttpResponsePtr response, bool bWasSuccessful)
+	const auto textureName = AvatarAssetName(currAvatar->code, TEXT("model.jpg"));
+	if (AssetCache::Get().Contains(textureName))
 	{
-		bool bIsOk;
-		auto textureBytes = HandleDataResponse(response, bWasSuccessful, bIsOk);
-		if (!bIsOk)
+		UE_LOG(LogAvatarSdk, Log, TEXT("Texture for avatar %s already downloaded!"), *currAvatar->code);
+		texturePath = AssetCache::Get().Find(textureName);
+		DisplayAvatar();
+		return;
+	}
+
+	TWeakObjectPtr<AGameAvatar> weakThis(this);
+	const auto onDownloaded = FOnAssetDownloaded::CreateLambda([weakThis, textureName](bool bSucceeded, const FFileBytes &textureBytes)
+	{
+		if (!bSucceeded)
 			return;
 
-		texturePath = FPaths::Combine(DownloadLocation(currAvatar->code), TEXT("model.jpg"));
-		SaveTArray(textureBytes, texturePath);
-		DisplayAvatar();
+		AssetCache::Get().Put(textureName, textureBytes, [weakThis, textureName](bool)
+		{
+			if (!weakThis.IsValid())
+				return;
+
+			weakThis->texturePath = AssetCache::Get().Find(textureName);
+			weakThis->DisplayAvatar();
+		});
 	});
-	UE_LOG(LogClass, Log, TEXT("Downloading texture for avatar: %s"), *currAvatar->code);
+	UE_LOG(LogAvatarSdk, Log, TEXT("Downloading texture for avatar: %s"), *currAvatar->code);
 	GEngine->AddOnScreenDebugMessage(-1, 5.f, FColor::Green, FString::Printf(TEXT("Downloading texture...")));
-	request->ProcessRequest();
+	RangedDownloader::Download(currAvatar->texture, AssetCache::Get().PartPath(textureName), onDownloaded);
 }
 
 void AGameAvatar::DisplayAvatar()
 {
 	if (meshPath.IsEmpty() || texturePath.IsEmpty())
 	{
-		UE_LOG(LogClass, Log, TEXT("Mesh %s, texture %s. Not all data downloaded, still waiting..."), *meshPath, *texturePath);
+		UE_LOG(LogAvatarSdk, Log, TEXT("Mesh %s, texture %s. Not all data downloaded, still waiting..."), *meshPath, *texturePath);
 		return;
 	}
 
 	GEngine->AddOnScreenDebugMessage(-1, 5.f, FColor::Green, FString::Printf(TEXT("Displaying avatar!")));
-	UE_LOG(LogClass, Log, TEXT("Mesh %s, texture %s. All downloaded! Displaying avatar in a scene..."), *meshPath, *texturePath);
+	UE_LOG(LogAvatarSdk, Log, TEXT("Mesh %s, texture %s. All downloaded! Displaying avatar in a scene..."), *meshPath, *texturePath);
 
-	std::string meshPathStr = std::string(TCHAR_TO_UTF8(*meshPath));
-	std::ifstream meshStream{ meshPathStr.c_str(), std::ios::in | std::ios::binary };
-	TArray<FVector> originalVertices;
-	TArray<int32> faces;
-	TArray<TArray<FVector2D>> faceUv;
-	ItSeez3D::LoadModelFromBinPLY(meshStream, &originalVertices, nullptr, &faces, &faceUv);
-	ItSeez3D::FlipNormals(faces, faceUv);
+	// the cooked mesh skips the PLY parsing, it is derived from the PLY and made on the first display
+	TWeakObjectPtr<AGameAvatar> weakThis(this);
+	const FString cookedName = AvatarAssetName(currAvatar->code, TEXT("model.cooked"));
+	const FString meshName = AvatarAssetName(currAvatar->code, TEXT("model.ply")), textureName = AvatarAssetName(currAvatar->code, TEXT("model.jpg"));
+	const bool bCooked = AssetCache::Get().Contains(cookedName);
+	AssetCache::Get().LoadAsync(bCooked ? cookedName : meshName, [weakThis, textureName, bCooked](const FFileBytes &meshBytes)
+	{
+		AssetCache::Get().LoadAsync(textureName, [weakThis, meshBytes, bCooked](const FFileBytes &textureBytes)
+		{
+			if (!weakThis.IsValid())
+				return;
 
-	TArray<FVector> vertices;
-	TArray<FVector2D> uv;
-	TArray<int> indexMap;
-	ItSeez3D::ConvertToUnrealFormat(originalVertices, faceUv, faces, vertices, uv, indexMap);
-	ItSeez3D::AdjustPhysicalUnits(vertices);
+			if (meshBytes.IsValid() && textureBytes.IsValid())
+			{
+				DecodeTextureAsync(textureBytes, EImageFormat::JPEG, [weakThis, meshBytes, bCooked](const FDecodedTexturePtr &texture)
+				{
+					if (weakThis.IsValid())
+						weakThis->CookAvatar(meshBytes, bCooked, texture);
+				});
+				return;
+			}
 
-	headMesh->CreateMeshSection_LinearColor(0, vertices, faces, TArray<FVector>(), uv, TArray<FLinearColor>(), TArray<FProcMeshTangent>(), true);
-	headMesh->AddLocalRotation(FRotator(0, 180, -90));
+			// the cache dropped the damaged files, download just those again
+			if (!weakThis->ShouldRefetchDamagedAssets())
+				return;
+			if (!textureBytes.IsValid())
+			{
+				weakThis->texturePath.Empty();
+				weakThis->DownloadHeadTexture();
+			}
+			if (!meshBytes.IsValid() && bCooked)
+				weakThis->DisplayAvatar();
+			else if (!meshBytes.IsValid())
+			{
+				weakThis->meshPath.Empty();
+				weakThis->DownloadHeadMesh();
+			}
+		});
+	});
+}
 
-	auto material = headMesh->CreateAndSetMaterialInstanceDynamicFromMaterial(0, headMaterial);
+void AGameAvatar::CookAvatar(const FFileBytes &meshBytes, bool bCooked, const FDecodedTexturePtr &texture)
+{
+	TWeakObjectPtr<AGameAvatar> weakThis(this);
+	const FString cookedName = AvatarAssetName(currAvatar->code, TEXT("model.cooked"));
+	Async<void>(EAsyncExecution::ThreadPool, [weakThis, meshBytes, bCooked, texture, cookedName]()
+	{
+		TSharedRef<CookedMesh, ESPMode::ThreadSafe> mesh = MakeShareable(new CookedMesh());
+		const bool bLoaded = bCooked ? LoadCookedMesh(*meshBytes, *mesh) : CookMesh(*meshBytes, *mesh);
+		FFileBytes cooked;
+		if (bLoaded && !bCooked)
+			cooked = MakeShareable(new TArray<uint8>(SaveCookedMesh(*mesh)));
 
-	UTexture2D *texture;
-	IImageWrapperModule& imageWrapperModule = FModuleManager::LoadModuleChecked<IImageWrapperModule>(FName("ImageWrapper"));
-	IImageWrapperPtr imageWrapper = imageWrapperModule.CreateImageWrapper(EImageFormat::JPEG);
-	TArray<uint8> textureData;
-	if (LoadTArray(texturePath, textureData) > 0)
-		if (imageWrapper.IsValid())
-			if (imageWrapper->SetCompressed(textureData.GetData(), textureData.Num()))
-			{
-				const TArray<uint8> *uncompressedBGRA = nullptr;
+		AsyncTask(ENamedThreads::GameThread, [weakThis, mesh, bLoaded, bCooked, cooked, texture, cookedName]()
+		{
+			if (cooked.IsValid())
+				AssetCache::Get().Put(cookedName, cooked);
 
-				if (imageWrapper->GetRaw(ERGBFormat::BGRA, 8, uncompressedBGRA))
-				{
-					const auto w = imageWrapper->GetWidth(), h = imageWrapper->GetHeight();
-					texture = UTexture2D::CreateTransient(w, h, PF_B8G8R8A8);
-
-					void *textureBytes = texture->PlatformData->Mips[0].BulkData.Lock(LOCK_READ_WRITE);
-					FMemory::Memcpy(textureBytes, uncompressedBGRA->GetData(), uncompressedBGRA->Num());
-					texture->PlatformData->Mips[0].BulkData.Unlock();
-					texture->UpdateResource();
-					material->SetTextureParameterValue(FName("Tex"), texture);
-				}
+			if (!bLoaded && bCooked)
+			{
+				UE_LOG(LogAvatarSdk, Log, TEXT("Cooked mesh %s is outdated, cooking it again"), *cookedName);
+				AssetCache::Get().Remove(cookedName);
+				if (weakThis.IsValid())
+					weakThis->DisplayAvatar();
+				return;
 			}
+
+			if (!bLoaded)
+				UE_LOG(LogAvatarSdk, Error, TEXT("Unable to parse the head mesh"));
+			else if (weakThis.IsValid())
+				weakThis->BuildAvatar(*mesh, texture);
+		});
+	});
 }
 
-void AGameAvatar::GetHaircuts()
+void AGameAvatar::BuildAvatar(const CookedMesh &mesh, const FDecodedTexturePtr &texture)
 {
-	auto request = GetRequest(currAvatar->haircuts);
-	request->OnProcessRequestComplete().BindUObject(this, &AGameAvatar::OnHaircutsRequested);
+	headMesh->CreateMeshSection_LinearColor(0, mesh.vertices, mesh.faces, TArray<FVector>(), mesh.uv, TArray<FLinearColor>(), TArray<FProcMeshTangent>(), true);
+	headMesh->AddLocalRotation(FRotator(0, 180, -90));
+
+	auto material = headMesh->CreateAndSetMaterialInstanceDynamicFromMaterial(0, headMaterial);
 
-	UE_LOG(LogClass, Log, TEXT("Getting list of haircuts for avatar: %s"), *(currAvatar->code));
-	request->ProcessRequest();
+	UTexture2D *headTexture = texture.IsValid() ? CreateAvatarTexture(*texture) : nullptr;
+	if (headTexture)
+		material->SetTextureParameterValue(FName("Tex"), headTexture);
+
+	if (startTime > 0)
+	{
+		ReportTimeToFirstAvatar(bWarmStart, FPlatformTime::Seconds() - startTime);
+		startTime = 0;
+	}
 }
 
-void AGameAvatar::OnHaircutsRequested(FHttpRequestPtr request, FHttpResponsePtr response, bool bWasSuccessful)
+void AGameAvatar::GetHaircuts()
 {
-	auto haircutsResponse = HandleJsonArrayResponse(response, bWasSuccessful);
-	if (!haircutsResponse.IsValid())
-		return;
+	UE_LOG(LogAvatarSdk, Log, TEXT("Getting list of haircuts for avatar: %s"), *(currAvatar->code));
+	TWeakObjectPtr<AGameAvatar> weakThis(this);
+	SendAuthorized(GetRequest(currAvatar->haircuts, AuthSession::Get().GetCredentials()), [weakThis](FHttpResponsePtr response, bool bWasSuccessful)
+	{
+		// the list of an avatar rarely changes, it is revalidated instead of downloaded again
+		HttpCache::Get().Resolve(response, [weakThis, bWasSuccessful](FHttpResponsePtr resolved)
+		{
+			if (weakThis.IsValid())
+				weakThis->OnHaircutsRequested(resolved, bWasSuccessful);
+		});
+	});
+}
 
-	auto haircutsArray = haircutsResponse->AsArray();
+void AGameAvatar::OnHaircutsRequested(FHttpResponsePtr response, bool bWasSuccessful)
+{
 	TArray<TSharedPtr<HaircutData>> availableHaircuts;
-	for (auto &haircutJson : haircutsArray)
-		availableHaircuts.Emplace(new HaircutData(*haircutJson->AsObject()));
+	if (!HandleHaircutsResponse(response, bWasSuccessful, availableHaircuts))
+		return;
 
 	if (availableHaircuts.Num() == 0)
 	{
-		UE_LOG(LogClass, Error, TEXT("No haircuts available"));
+		UE_LOG(LogAvatarSdk, Error, TEXT("No haircuts available"));
+		PipelineCheckpoint::Get().MarkFinished();
 		return;
 	}
 
-	// choose random haircut to display
-	const int haircutIdx = rand() % availableHaircuts.Num();
-	currHaircut = availableHaircuts[haircutIdx];
+	// keep the haircut chosen before a restart, otherwise choose random haircut to display
+	const auto chosenHaircut = PipelineCheckpoint::Get().ChosenHaircut(currAvatar->code);
+	const auto *chosen = chosenHaircut.IsValid() ? availableHaircuts.FindByPredicate([&chosenHaircut](const TSharedPtr<HaircutData> &haircut)
+	{
+		return haircut->id == chosenHaircut->id;
+	}) : nullptr;
+	currHaircut = chosen ? *chosen : availableHaircuts[rand() % availableHaircuts.Num()];
+	PipelineCheckpoint::Get().SaveHaircut(*currHaircut);
 
 	DownloadHaircutMesh();
 	DownloadHaircutTexture();
 	DownloadHaircutPoints();
+
+	// the rest of the list is downloaded in background, so switching haircuts later is instant
+	HaircutPrefetcher::Get().RecordSelection(currHaircut->id);
+	HaircutPrefetcher::Get().Prefetch(availableHaircuts, currHaircut->id);
 }
 
 void AGameAvatar::DownloadHaircutMesh()
 {
-	if (FPaths::FileExists(HaircutFilePath(HaircutFile::MESH, currHaircut->id)))
+	const bool bMeshExists = IsHaircutAssetAvailable(HaircutFile::MESH, currHaircut->id);
+	HaircutPrefetcher::Get().ReportForegroundRequest(currHaircut->id, bMeshExists);
+	if (bMeshExists)
+		UE_LOG(LogAvatarSdk, Log, TEXT("Mesh for haircut %s already downloaded!"), *(currHaircut->id));
+	else
 	{
-		UE_LOG(LogClass, Log, TEXT("Mesh for haircut %s already downloaded!"), *(currHaircut->id));
-		haircutMeshDownloaded = true;
-		DisplayHaircut();
-		return;
+		UE_LOG(LogAvatarSdk, Log, TEXT("Downloading haircut mesh for avatar: %s"), *currAvatar->code);
+		GEngine->AddOnScreenDebugMessage(-1, 3.f, FColor::Green, FString::Printf(TEXT("Downloading haircut mesh...")));
 	}
 
-	auto request = GetRequest(currHaircut->mesh);
-	request->OnProcessRequestComplete().BindLambda([&](FHttpRequestPtr req, FHttpResponsePtr response, bool bWasSuccessful)
+	TWeakObjectPtr<AGameAvatar> weakThis(this);
+	FetchHaircutAsset(HaircutFile::MESH, *currHaircut, FOnFlightCompleted::CreateLambda([weakThis](bool bSucceeded)
 	{
-		bool bIsOk;
-		auto meshResponse = HandleDataResponse(response, bWasSuccessful, bIsOk);
-		if (!bIsOk)
+		if (!bSucceeded || !weakThis.IsValid())
 			return;
 
-		const auto meshArchivePath = HaircutFilePath(HaircutFile::MESH_ZIP, currHaircut->id);
-		SaveTArray(meshResponse, meshArchivePath);
-
-		if (ItSeez3D::UnzipFile(meshArchivePath))
-		{
-			UE_LOG(LogClass, Log, TEXT("Unzip completed for haircut mesh archive!"));
-			haircutMeshDownloaded = true;
-			DisplayHaircut();
-		}
-	});
-	UE_LOG(LogClass, Log, TEXT("Downloading haircut mesh for avatar: %s"), *currAvatar->code);
-	GEngine->AddOnScreenDebugMessage(-1, 3.f, FColor::Green, FString::Printf(TEXT("Downloading haircut mesh...")));
-	request->ProcessRequest();
+		weakThis->haircutMeshDownloaded = true;
+		weakThis->DisplayHaircut();
+	}));
 }
 
 void AGameAvatar::DownloadHaircutTexture()
 {
-	if (FPaths::FileExists(HaircutFilePath(HaircutFile::TEXTURE, currHaircut->id)))
+	const bool bTextureExists = IsHaircutAssetAvailable(HaircutFile::TEXTURE, currHaircut->id);
+	HaircutPrefetcher::Get().ReportForegroundRequest(currHaircut->id, bTextureExists);
+	if (bTextureExists)
+		UE_LOG(LogAvatarSdk, Log, TEXT("Texture for haircut %s already downloaded!"), *(currHaircut->id));
+	else
 	{
-		UE_LOG(LogClass, Log, TEXT("Texture for haircut %s already downloaded!"), *(currHaircut->id));
-		haircutTextureDownloaded = true;
-		DisplayHaircut();
-		return;
+		UE_LOG(LogAvatarSdk, Log, TEXT("Downloading haircut texture for avatar: %s"), *currAvatar->code);
+		GEngine->AddOnScreenDebugMessage(-1, 3.f, FColor::Green, FString::Printf(TEXT("Downloading haircut texture...")));
 	}
 
-	auto request = GetRequest(currHaircut->texture);
-	request->OnProcessRequestComplete().BindLambda([&](FHttpRequestPtr, FHttpResponsePtr response, bool bWasSuccessful)
+	TWeakObjectPtr<AGameAvatar> weakThis(this);
+	FetchHaircutAsset(HaircutFile::TEXTURE, *currHaircut, FOnFlightCompleted::CreateLambda([weakThis](bool bSucceeded)
 	{
-		bool bIsOk;
-		auto textureBytes = HandleDataResponse(response, bWasSuccessful, bIsOk);
-		if (!bIsOk)
+		if (!bSucceeded || !weakThis.IsValid())
 			return;
 
-		SaveTArray(textureBytes, HaircutFilePath(HaircutFile::TEXTURE, currHaircut->id));
-		haircutTextureDownloaded = true;
-		DisplayHaircut();
-	});
-	UE_LOG(LogClass, Log, TEXT("Downloading haircut texture for avatar: %s"), *currAvatar->code);
-	GEngine->AddOnScreenDebugMessage(-1, 3.f, FColor::Green, FString::Printf(TEXT("Downloading haircut texture...")));
-	request->ProcessRequest();
+		weakThis->haircutTextureDownloaded = true;
+		weakThis->DisplayHaircut();
+	}));
 }
 
 void AGameAvatar::DownloadHaircutPoints()
 {
-	auto request = GetRequest(currHaircut->pointCloud);
-	request->OnProcessRequestComplete().BindLambda([&](FHttpRequestPtr, FHttpResponsePtr response, bool bWasSuccessful)
+	const auto pointsName = HaircutAvatarAssetName(AvatarFile::HAIRCUT_POINTS_PLY, currAvatar->code, currHaircut->id);
+	if (AssetCache::Get().Contains(pointsName))
 	{
-		bool bIsOk;
-		auto pointsArchiveResponse = HandleDataResponse(response, bWasSuccessful, bIsOk);
-		if (!bIsOk)
-			return;
+		UE_LOG(LogAvatarSdk, Log, TEXT("Points of haircut %s already downloaded!"), *currHaircut->id);
+		haircutPointsDownloaded = true;
+		DisplayHaircut();
+		return;
+	}
 
-		const auto pointsArchivePath = HaircutAvatarFilePath(AvatarFile::HAIRCUT_POINTS_ZIP, currAvatar->code, currHaircut->id);
-		SaveTArray(pointsArchiveResponse, pointsArchivePath);
+	TWeakObjectPtr<AGameAvatar> weakThis(this);
+	const FString code = currAvatar->code, url = currHaircut->pointCloud;
+	const auto onDownloaded = FOnAssetDownloaded::CreateLambda([weakThis, code, url](bool bSucceeded, const FFileBytes &pointsArchiveResponse)
+	{
+		if (!bSucceeded)
+			return;
 
-		if (ItSeez3D::UnzipFile(pointsArchivePath))
+		AssetCache::Get().PutArchive(AvatarAssetName(code, FString()), pointsArchiveResponse, [weakThis, url](bool bStored)
 		{
-			UE_LOG(LogClass, Log, TEXT("Unzip completed for haircut points!"));
-			haircutPointsDownloaded = true;
-			DisplayHaircut();
-		}
+			if (!bStored)
+				return;
+
+			UE_LOG(LogAvatarSdk, Log, TEXT("Unzip completed for haircut points!"));
+			HttpCache::Get().Remove(url);
+			if (weakThis.IsValid())
+			{
+				weakThis->haircutPointsDownloaded = true;
+				weakThis->DisplayHaircut();
+			}
+		});
 	});
-	UE_LOG(LogClass, Log, TEXT("Downloading haircut points for avatar: %s"), *currAvatar->code);
+	UE_LOG(LogAvatarSdk, Log, TEXT("Downloading haircut points for avatar: %s"), *currAvatar->code);
 	GEngine->AddOnScreenDebugMessage(-1, 3.f, FColor::Green, FString::Printf(TEXT("Downloading haircut points...")));
-	request->ProcessRequest();
+	RangedDownloader::Download(currHaircut->pointCloud, AssetCache::Get().PartPath(pointsName + TEXT(".zip")), onDownloaded);
 }
 
 void AGameAvatar::DisplayHaircut()
 {
 	if (!haircutTextureDownloaded || !haircutMeshDownloaded || !haircutPointsDownloaded)
 	{
-		UE_LOG(LogClass, Log, TEXT("Hair mesh %d, hair texture %d, points %d. Not all data downloaded, still waiting..."), haircutMeshDownloaded, haircutTextureDownloaded, haircutPointsDownloaded);
+		UE_LOG(LogAvatarSdk, Log, TEXT("Hair mesh %d, hair texture %d, points %d. Not all data downloaded, still waiting..."), haircutMeshDownloaded, haircutTextureDownloaded, haircutPointsDownloaded);
 		return;
 	}
 
-	UE_LOG(LogClass, Log, TEXT("Hair mesh %d, hair texture %d, points %d. All downloaded! Displaying haircut in a scene..."), haircutMeshDownloaded, haircutTextureDownloaded, haircutPointsDownloaded);
+	UE_LOG(LogAvatarSdk, Log, TEXT("Hair mesh %d, hair texture %d, points %d. All downloaded! Displaying haircut in a scene..."), haircutMeshDownloaded, haircutTextureDownloaded, haircutPointsDownloaded);
 	GEngine->AddOnScreenDebugMessage(-1, 3.f, FColor::Green, FString::Printf(TEXT("Displaying haircut in a scene!")));
 
-	std::string pointsPathStr = std::string(TCHAR_TO_UTF8(*HaircutAvatarFilePath(AvatarFile::HAIRCUT_POINTS_PLY, currAvatar->code, currHaircut->id)));
-	std::ifstream pointsStream{ pointsPathStr.c_str(), std::ios::in | std::ios::binary };
+	TWeakObjectPtr<AGameAvatar> weakThis(this);
+	const FString meshName = HaircutAssetName(HaircutFile::MESH, currHaircut->id), textureName = HaircutAssetName(HaircutFile::TEXTURE, currHaircut->id);
+	AssetCache::Get().LoadAsync(HaircutAvatarAssetName(AvatarFile::HAIRCUT_POINTS_PLY, currAvatar->code, currHaircut->id), [weakThis, meshName, textureName](const FFileBytes &pointsBytes)
+	{
+		AssetCache::Get().LoadAsync(meshName, [weakThis, textureName, pointsBytes](const FFileBytes &meshBytes)
+		{
+			AssetCache::Get().LoadAsync(textureName, [weakThis, pointsBytes, meshBytes](const FFileBytes &textureBytes)
+			{
+				if (!weakThis.IsValid())
+					return;
+
+				if (pointsBytes.IsValid() && meshBytes.IsValid() && textureBytes.IsValid())
+				{
+					DecodeTextureAsync(textureBytes, EImageFormat::PNG, [weakThis, pointsBytes, meshBytes](const FDecodedTexturePtr &texture)
+					{
+						if (weakThis.IsValid())
+							weakThis->BuildHaircut(*pointsBytes, *meshBytes, texture);
+					});
+					return;
+				}
+
+				if (!weakThis->ShouldRefetchDamagedAssets())
+					return;
+				if (!pointsBytes.IsValid())
+				{
+					weakThis->haircutPointsDownloaded = false;
+					weakThis->DownloadHaircutPoints();
+				}
+				if (!meshBytes.IsValid())
+				{
+					weakThis->haircutMeshDownloaded = false;
+					weakThis->DownloadHaircutMesh();
+				}
+				if (!textureBytes.IsValid())
+				{
+					weakThis->haircutTextureDownloaded = false;
+					weakThis->DownloadHaircutTexture();
+				}
+			});
+		});
+	});
+}
+
+bool AGameAvatar::ShouldRefetchDamagedAssets()
+{
+	if (damagedAssetRefetches >= maxDamagedAssetRefetches)
+	{
+		UE_LOG(LogAvatarSdk, Error, TEXT("Cached assets are damaged again after %d downloads, giving up"), damagedAssetRefetches);
+		return false;
+	}
+
+	++damagedAssetRefetches;
+	UE_LOG(LogAvatarSdk, Warning, TEXT("Cached assets are damaged, downloading them again"));
+	return true;
+}
+
+void AGameAvatar::BuildHaircut(const TArray<uint8> &pointsBytes, const TArray<uint8> &meshBytes, const FDecodedTexturePtr &texture)
+{
 	TArray<FVector> points;
-	ItSeez3D::LoadModelFromBinPLY(pointsStream, &points);
+	ItSeez3D::LoadModelFromBinPLY(pointsBytes, &points);
 
-	std::string meshPathStr = std::string(TCHAR_TO_UTF8(*HaircutFilePath(HaircutFile::MESH, currHaircut->id)));
-	std::ifstream meshStream{ meshPathStr.c_str(), std::ios::in | std::ios::binary };
 	TArray<FVector> originalVertices;
 	TArray<int32> faces;
 	TArray<TArray<FVector2D>> faceUv;
-	ItSeez3D::LoadModelFromBinPLY(meshStream, &originalVertices, nullptr, &faces, &faceUv);
+	ItSeez3D::LoadModelFromBinPLY(meshBytes, &originalVertices, nullptr, &faces, &faceUv);
 	originalVertices.Empty();
 	originalVertices = points;
 	ItSeez3D::FlipNormals(faces, faceUv);
@@ -791,34 +754,30 @@ void AGameAvatar::DisplayHaircut()
 
 	auto material = haircutMesh->CreateAndSetMaterialInstanceDynamicFromMaterial(0, hairMaterial);
 
-	UTexture2D *texture;
-	IImageWrapperModule& imageWrapperModule = FModuleManager::LoadModuleChecked<IImageWrapperModule>(FName("ImageWrapper"));
-	IImageWrapperPtr imageWrapper = imageWrapperModule.CreateImageWrapper(EImageFormat::PNG);
-	TArray<uint8> textureData;
-	if (LoadTArray(HaircutFilePath(HaircutFile::TEXTURE, currHaircut->id), textureData))
-		if (imageWrapper.IsValid())
-			if (imageWrapper->SetCompressed(textureData.GetData(), textureData.Num()))
-			{
-				const TArray<uint8> *uncompressedBGRA = nullptr;
-
-				if (imageWrapper->GetRaw(ERGBFormat::BGRA, 8, uncompressedBGRA))
-				{
-					const auto w = imageWrapper->GetWidth(), h = imageWrapper->GetHeight();
-					texture = UTexture2D::CreateTransient(w, h, PF_B8G8R8A8);
-
-					void *textureBytes = texture->PlatformData->Mips[0].BulkData.Lock(LOCK_READ_WRITE);
-					FMemory::Memcpy(textureBytes, uncompressedBGRA->GetData(), uncompressedBGRA->Num());
-					texture->PlatformData->Mips[0].BulkData.Unlock();
-					texture->UpdateResource();
-					material->SetTextureParameterValue(FName("Tex"), texture);
-				}
-			}
+	UTexture2D *hairTexture = texture.IsValid() ? CreateAvatarTexture(*texture) : nullptr;
+	if (hairTexture)
+		material->SetTextureParameterValue(FName("Tex"), hairTexture);
 
+	PipelineCheckpoint::Get().MarkFinished();
 	GEngine->AddOnScreenDebugMessage(-1, 100500.f, FColor::Yellow, FString::Printf(TEXT("Avatar with random haircut was generated. Restart the sample to create another one.")));
+
+	if (bMeasuringLoad)
+	{
+		bMeasuringLoad = false;
+		UE_LOG(LogAvatarSdk, Log, TEXT("Avatar loaded in %.2f s, worst frame %.1f ms of %d frames, %s file io"), FPlatformTime::Seconds() - loadStartTime,
+			worstLoadFrame * 1000.0f, loadFrames, IsFileIOSynchronous() ? TEXT("synchronous") : TEXT("asynchronous"));
+	}
 }
 
 // Called every frame
 void AGameAvatar::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
+
+	// hitches while the assets are downloaded, stored and displayed
+	if (bMeasuringLoad)
+	{
+		worstLoadFrame = FMath::Max(worstLoadFrame, DeltaTime);
+		++loadFrames;
+	}
 }
@@ -15,8 +15,16 @@
 
 #include "Runtime/Online/HTTP/Public/Http.h"
 
+#include "AsyncFileIO.h"
+#include "AvatarApi.h"
+#include "AvatarTexture.h"
+
 #include "GameAvatar.generated.h"
 
+namespace ItSeez3D
+{
+	struct CookedMesh;
+}
 
 UCLASS()
 class AVATARSDKSAMPLE_API AGameAvatar : public AActor
@@ -38,54 +46,59 @@ protected:
 	void GenerateAvatar();
 
 private:
-	void SetCommonHeaders(const TSharedRef<IHttpRequest> &req) const;
-	TSharedRef<IHttpRequest> GetRequest(const FString &url);
-	TSharedRef<IHttpRequest> PostRequest(const FString &url, class MultipartRequestBody &form);
-	static bool HandleResponse(FHttpResponsePtr response, bool bWasSuccessful);
-	static TSharedPtr<class FJsonObject> HandleJsonResponse(FHttpResponsePtr response, bool bWasSuccessful);
-	static TSharedPtr<class FJsonValue> HandleJsonArrayResponse(FHttpResponsePtr response, bool bWasSuccessful);
-	static const TArray<uint8> & HandleDataResponse(FHttpResponsePtr response, bool bWasSuccessful, bool &bIsOk);
+	void OnCredentialsReady(bool bSucceeded, const ItSeez3D::Credentials &sessionCredentials);
 
-	void Authorize();
-	void OnAuthorizationCompleted(FHttpRequestPtr request, FHttpResponsePtr response, bool bWasSuccessful);
-
-	void RegisterPlayer();
-	void OnPlayerRegistered(FHttpRequestPtr request, FHttpResponsePtr response, bool bWasSuccessful);
+	/// WarmStart in the game config: displays the most recently used cached avatar without touching the network.
+	bool StartFromCache();
 
 	void CreateAvatarWithPhotoFromWeb(const FString &url);
-	void CreateAvatarWithPhotoFilesystem();
-	void OnPhotoUploaded(FHttpRequestPtr request, FHttpResponsePtr response, bool bWasSuccessful);
+	void CreateAvatarWithPhotoFilesystem(const FString &photoPath);
+	void UploadPhoto(const uint8 *data, int64 size, const FString &photoKey);
+	void OnPhotoUploaded(FHttpResponsePtr response, bool bWasSuccessful, const FString &photoKey);
 
 	void CheckAvatarStatus();
-	void OnAvatarStatusRequested(FHttpRequestPtr request, FHttpResponsePtr response, bool bWasSuccessful);
+	void OnAvatarStatusUpdated(TSharedPtr<ItSeez3D::AvatarData> avatar);
 
 	void DownloadHeadMesh();
 	void DownloadHeadTexture();
 
 	void DisplayAvatar();
+	void CookAvatar(const ItSeez3D::FFileBytes &meshBytes, bool bCooked, const ItSeez3D::FDecodedTexturePtr &texture);
+	void BuildAvatar(const ItSeez3D::CookedMesh &mesh, const ItSeez3D::FDecodedTexturePtr &texture);
 
 	void GetHaircuts();
-	void OnHaircutsRequested(FHttpRequestPtr request, FHttpResponsePtr response, bool bWasSuccessful);
+	void OnHaircutsRequested(FHttpResponsePtr response, bool bWasSuccessful);
 
 	void DownloadHaircutMesh();
 	void DownloadHaircutTexture();
 	void DownloadHaircutPoints();
 
 	void DisplayHaircut();
+	void BuildHaircut(const TArray<uint8> &pointsBytes, const TArray<uint8> &meshBytes, const ItSeez3D::FDecodedTexturePtr &texture);
 
-private:
-	class FHttpModule *http;
-
-	FTimerHandle awaitTimer;
+	bool ShouldRefetchDamagedAssets();
 
-	TSharedPtr<struct AvatarData> currAvatar;
+private:
+	TSharedPtr<ItSeez3D::AvatarData> currAvatar;
 	FString meshPath, texturePath;
 
-	TSharedPtr<struct HaircutData> currHaircut;
+	// photo of a reused avatar, uploaded again if the server no longer knows the avatar
+	TArray<uint8> reusedPhoto;
+	FString reusedPhotoKey;
+
+	TSharedPtr<ItSeez3D::HaircutData> currHaircut;
 	bool haircutMeshDownloaded = false, haircutTextureDownloaded = false, haircutPointsDownloaded = false;
+	int32 damagedAssetRefetches = 0;
+
+	// time to the first displayed avatar, from GenerateAvatar
+	bool bWarmStart = false;
+	double startTime = 0;
 
-	// authentication data
-	FString tokenType, accessToken, playerUID;
+	// worst frame time from the avatar computation finish to the haircut display
+	bool bMeasuringLoad = false;
+	double loadStartTime = 0;
+	float worstLoadFrame = 0;
+	int32 loadFrames = 0;
 
 	// UE objects
 	UPROPERTY(VisibleAnywhere, Category = "AvatarSDK")
@@ -0,0 +1,65 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#include "HaircutAssets.h"
+
+#include "AssetCache.h"
+#include "AvatarSdkSample.h"
+#include "HttpCache.h"
+
+
+FString ItSeez3D::HaircutAssetKey(HaircutFile file, const FString &haircutId)
+{
+	return FString::Printf(TEXT("haircut_%s/%s"), file == HaircutFile::MESH ? TEXT("mesh") : TEXT("texture"), *haircutId);
+}
+
+bool ItSeez3D::IsHaircutAssetAvailable(HaircutFile file, const FString &haircutId)
+{
+	return !SingleFlight::Get().IsInFlight(HaircutAssetKey(file, haircutId)) && AssetCache::Get().Contains(HaircutAssetName(file, haircutId));
+}
+
+void ItSeez3D::FetchHaircutAsset(HaircutFile file, const HaircutData &haircut, const FOnFlightCompleted &onReady,
+	const FRangeRequestDispatcher &dispatcher)
+{
+	if (IsHaircutAssetAvailable(file, haircut.id))
+	{
+		onReady.ExecuteIfBound(true);
+		return;
+	}
+
+	const FString id = haircut.id;
+	const FString url = file == HaircutFile::MESH ? haircut.mesh : haircut.texture;
+	SingleFlight::Get().Join(HaircutAssetKey(file, id), onReady, [file, id, url, dispatcher](const FFlightDone &done)
+	{
+		const auto name = HaircutAssetName(file, id);
+		RangedDownloader::Download(url, AssetCache::Get().PartPath(name), FOnAssetDownloaded::CreateLambda([file, id, url, name, done](bool bSucceeded, const FFileBytes &content)
+		{
+			const auto onStored = [file, id, url, name, done](bool bStored)
+			{
+				if (file == HaircutFile::MESH)
+				{
+					bStored = bStored && AssetCache::Get().Contains(name);
+					if (bStored)
+						HttpCache::Get().Remove(url);
+				}
+
+				UE_LOG(LogAvatarSdk, Log, TEXT("%s of haircut %s ready: %d"), file == HaircutFile::MESH ? TEXT("Mesh") : TEXT("Texture"), *id, int(bStored));
+				done(bStored);
+			};
+
+			if (!bSucceeded)
+				onStored(false);
+			else if (file == HaircutFile::MESH)
+				AssetCache::Get().PutArchive(TEXT("haircuts/"), content, onStored);
+			else
+				AssetCache::Get().Put(name, content, onStored);
+		}), dispatcher);
+	});
+}
@@ -0,0 +1,32 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "AvatarApi.h"
+#include "RangedDownloader.h"
+#include "SingleFlight.h"
+
+
+namespace ItSeez3D
+{
+	/// Single-flight key of a shared haircut asset.
+	FString HaircutAssetKey(HaircutFile file, const FString &haircutId);
+
+	/// The asset is cached and nobody is writing it right now.
+	bool IsHaircutAssetAvailable(HaircutFile file, const FString &haircutId);
+
+	/// Puts the mesh (unzipped) or the texture of the haircut to the AssetCache as HaircutAssetName. All actors and the prefetcher
+	/// asking for the same asset at once share one download and one unzip, every one of them gets the result.
+	/// The dispatcher is used only if this call starts the download.
+	void FetchHaircutAsset(HaircutFile file, const HaircutData &haircut, const FOnFlightCompleted &onReady, const FRangeRequestDispatcher &dispatcher = FRangeRequestDispatcher());
+}
@@ -0,0 +1,241 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#include "HaircutPrefetcher.h"
+
+#include "Paths.h"
+#include "Containers/Ticker.h"
+#include "Misc/ConfigCacheIni.h"
+#include "Misc/FileHelper.h"
+
+#include "Runtime/Json/Public/Json.h"
+
+#include "AssetCache.h"
+#include "AsyncFileIO.h"
+#include "AvatarSdkSample.h"
+#include "AvatarSdkStats.h"
+#include "HaircutAssets.h"
+
+
+DEFINE_STAT(STAT_AvatarSdk_PrefetchHits);
+DEFINE_STAT(STAT_AvatarSdk_PrefetchMisses);
+
+
+namespace
+{
+	const float tickInterval = 0.05f;
+
+	// priority weights: the user's history, then the server order
+	const float selectionCountPriority = 1e3f;
+
+	struct ByPriority
+	{
+		template <typename T>
+		bool operator()(const T &a, const T &b) const
+		{
+			return a.priority > b.priority;
+		}
+	};
+
+	FString HistoryPath()
+	{
+		return FPaths::Combine(ItSeez3D::HaircutDownloadLocation(), TEXT("selections.json"));
+	}
+}
+
+ItSeez3D::HaircutPrefetcher & ItSeez3D::HaircutPrefetcher::Get()
+{
+	static HaircutPrefetcher prefetcher;
+	return prefetcher;
+}
+
+ItSeez3D::HaircutPrefetcher::HaircutPrefetcher()
+{
+	int32 maxKBps = 256;
+	if (GConfig)
+		GConfig->GetInt(configSection, TEXT("HaircutPrefetchKBps"), maxKBps, GGameIni);
+	maxBytesPerSecond = FMath::Max(0, maxKBps) * 1024.0f;
+
+	LoadHistory();
+}
+
+void ItSeez3D::HaircutPrefetcher::Prefetch(const TArray<TSharedPtr<HaircutData>> &haircuts, const FString &selectedId)
+{
+	if (maxBytesPerSecond <= 0)
+		return;
+
+	int32 queued = 0;
+	for (int32 i = 0; i < haircuts.Num(); ++i)
+	{
+		const auto &haircut = haircuts[i];
+		// the selected haircut is downloaded by the foreground at full speed
+		if (haircut->id == selectedId || queuedIds.Contains(haircut->id))
+			continue;
+		if (AssetCache::Get().Contains(HaircutAssetName(HaircutFile::MESH, haircut->id)) && AssetCache::Get().Contains(HaircutAssetName(HaircutFile::TEXTURE, haircut->id)))
+			continue;
+
+		Item item;
+		item.haircut = haircut;
+		item.priority = float(haircuts.Num() - i);
+		if (const int32 *count = selectionCounts.Find(haircut->id))
+			item.priority += *count * selectionCountPriority;
+
+		queue.HeapPush(item, ByPriority());
+		queuedIds.Add(haircut->id);
+		++queued;
+	}
+
+	UE_LOG(LogAvatarSdk, Log, TEXT("Queued %d haircuts for prefetching, %d in queue"), queued, queue.Num());
+	StartNext();
+}
+
+void ItSeez3D::HaircutPrefetcher::RecordSelection(const FString &haircutId)
+{
+	++selectionCounts.FindOrAdd(haircutId);
+	SaveHistory();
+}
+
+void ItSeez3D::HaircutPrefetcher::ReportForegroundRequest(const FString &haircutId, bool bAvailableLocally)
+{
+	if (bAvailableLocally && prefetchedIds.Contains(haircutId))
+	{
+		++hits;
+		INC_DWORD_STAT(STAT_AvatarSdk_PrefetchHits);
+	}
+	else if (!bAvailableLocally)
+	{
+		++misses;
+		INC_DWORD_STAT(STAT_AvatarSdk_PrefetchMisses);
+	}
+	else
+		return;
+
+	UE_LOG(LogAvatarSdk, Log, TEXT("Prefetch hit rate %.0f%% (%d hits, %d misses)"), 100.0f * hits / (hits + misses), hits, misses);
+}
+
+void ItSeez3D::HaircutPrefetcher::StartNext()
+{
+	while (assetsInFlight == 0 && queue.Num() > 0)
+	{
+		Item item;
+		queue.HeapPop(item, ByPriority());
+		const auto haircut = item.haircut;
+		queuedIds.Remove(haircut->id);
+
+		const FString id = haircut->id;
+		for (const auto file : { HaircutFile::MESH, HaircutFile::TEXTURE })
+		{
+			if (IsHaircutAssetAvailable(file, id))
+				continue;
+
+			const auto key = HaircutAssetKey(file, id);
+			const auto dispatcher = [this, key](const TSharedRef<IHttpRequest> &request, const FRangeResponseHandler &handler)
+			{
+				Dispatch(key, request, handler);
+			};
+
+			++assetsInFlight;
+			FetchHaircutAsset(file, *haircut, FOnFlightCompleted::CreateLambda([this, id](bool)
+			{
+				OnAssetDone(id);
+			}), dispatcher);
+		}
+	}
+}
+
+void ItSeez3D::HaircutPrefetcher::OnAssetDone(FString haircutId)
+{
+	if (--assetsInFlight > 0)
+		return;
+
+	if (AssetCache::Get().Contains(HaircutAssetName(HaircutFile::MESH, haircutId)) && AssetCache::Get().Contains(HaircutAssetName(HaircutFile::TEXTURE, haircutId)))
+	{
+		prefetchedIds.Add(haircutId);
+		UE_LOG(LogAvatarSdk, Log, TEXT("Prefetched haircut %s, %d left in queue"), *haircutId, queue.Num());
+	}
+	StartNext();
+}
+
+void ItSeez3D::HaircutPrefetcher::Dispatch(const FString &assetKey, const TSharedRef<IHttpRequest> &request, const FRangeResponseHandler &handler)
+{
+	HeldRequest held = { assetKey, request, handler };
+	heldRequests.Add(held);
+	if (!tickHandle.IsValid())
+		tickHandle = FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &HaircutPrefetcher::OnTick), tickInterval);
+}
+
+bool ItSeez3D::HaircutPrefetcher::OnTick(float deltaTime)
+{
+	if (heldRequests.Num() == 0 && !bRequestInFlight)
+	{
+		tickHandle.Reset();
+		return false;
+	}
+
+	if (bRequestInFlight || heldRequests.Num() == 0)
+		return true;
+
+	// an actor attached to this asset and waits for it, the download is no longer a background one
+	int32 index = heldRequests.IndexOfByPredicate([](const HeldRequest &held) { return SingleFlight::Get().NumWaiters(held.assetKey) > 1; });
+
+	// otherwise one range at a time, paced by the size of the previous one, and nothing while the user waits for a download
+	const double now = FPlatformTime::Seconds();
+	if (index == INDEX_NONE)
+	{
+		if (now < nextSendTime || RangedDownloader::NumForegroundDownloads() > 0)
+			return true;
+		index = 0;
+	}
+
+	auto request = heldRequests[index].request;
+	const auto handler = heldRequests[index].handler;
+	heldRequests.RemoveAt(index, 1, false);
+
+	bRequestInFlight = true;
+	request->OnProcessRequestComplete().BindLambda([this, handler](FHttpRequestPtr, FHttpResponsePtr response, bool bWasSuccessful)
+	{
+		bRequestInFlight = false;
+		const int32 bytes = response.IsValid() ? response->GetContent().Num() : 0;
+		nextSendTime = FPlatformTime::Seconds() + bytes / maxBytesPerSecond;
+		handler(response, bWasSuccessful);
+	});
+	request->ProcessRequest();
+	return true;
+}
+
+void ItSeez3D::HaircutPrefetcher::LoadHistory()
+{
+	FString text;
+	if (!FFileHelper::LoadFileToString(text, *HistoryPath(), FILEREAD_Silent))
+		return;
+
+	TSharedPtr<FJsonObject> json;
+	auto reader = TJsonReaderFactory<>::Create(text);
+	if (!FJsonSerializer::Deserialize(reader, json) || !json.IsValid())
+		return;
+
+	for (const auto &field : json->Values)
+		selectionCounts.Add(field.Key, int32(field.Value->AsNumber()));
+}
+
+void ItSeez3D::HaircutPrefetcher::SaveHistory() const
+{
+	TSharedRef<FJsonObject> json = MakeShareable(new FJsonObject());
+	for (const auto &pair : selectionCounts)
+		json->SetNumberField(pair.Key, pair.Value);
+
+	FString text;
+	auto writer = TJsonWriterFactory<>::Create(&text);
+	FJsonSerializer::Serialize(json, writer);
+
+	const FTCHARToUTF8 utf8(*text);
+	TArray<uint8> bytes((const uint8 *)utf8.Get(), utf8.Length());
+	SaveFileAsync(HistoryPath(), MoveTemp(bytes));
+}
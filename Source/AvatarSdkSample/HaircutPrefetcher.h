@@ -0,0 +1,79 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "AvatarApi.h"
+#include "RangedDownloader.h"
+
+
+namespace ItSeez3D
+{
+	/// Downloads shared meshes and textures of the available haircuts into the haircut location in the background,
+	/// so switching to another haircut does not wait for the network. The selected haircut is left to the foreground,
+	/// the ones the user selected most often go first, then the server order. Transfers are limited to HaircutPrefetchKBps (game config,
+	/// zero disables prefetching) and no new chunk is requested while a foreground download runs.
+	class HaircutPrefetcher
+	{
+	public:
+		static HaircutPrefetcher & Get();
+
+		/// Call after the foreground downloads of the selected haircut have started.
+		void Prefetch(const TArray<TSharedPtr<HaircutData>> &haircuts, const FString &selectedId);
+
+		/// Remembered across sessions, raises the priority of the haircut in later prefetches.
+		void RecordSelection(const FString &haircutId);
+
+		/// Call when the foreground needs a haircut asset, counts prefetch hits and misses.
+		void ReportForegroundRequest(const FString &haircutId, bool bAvailableLocally);
+
+	private:
+		struct Item
+		{
+			TSharedPtr<HaircutData> haircut;
+			float priority;
+		};
+
+		HaircutPrefetcher();
+
+		void StartNext();
+		void OnAssetDone(FString haircutId);
+
+		// paces the range requests of the prefetch downloads
+		void Dispatch(const FString &assetKey, const TSharedRef<IHttpRequest> &request, const FRangeResponseHandler &handler);
+		bool OnTick(float deltaTime);
+
+		void LoadHistory();
+		void SaveHistory() const;
+
+	private:
+		float maxBytesPerSecond = 0;
+
+		TArray<Item> queue;
+		TSet<FString> queuedIds, prefetchedIds;
+		int32 assetsInFlight = 0;
+
+		struct HeldRequest
+		{
+			FString assetKey;
+			TSharedRef<IHttpRequest> request;
+			FRangeResponseHandler handler;
+		};
+		TArray<HeldRequest> heldRequests;
+		bool bRequestInFlight = false;
+		double nextSendTime = 0;
+		FDelegateHandle tickHandle;
+
+		TMap<FString, int32> selectionCounts;
+		int32 hits = 0, misses = 0;
+	};
+}
@@ -0,0 +1,214 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#include "HttpCache.h"
+
+#include "Paths.h"
+#include "Misc/FileHelper.h"
+
+#include "Runtime/Json/Public/Json.h"
+
+#include "AssetCache.h"
+#include "AsyncFileIO.h"
+#include "AuthSession.h"
+#include "AvatarApi.h"
+#include "AvatarSdkSample.h"
+#include "AvatarSdkStats.h"
+#include "HttpRecordReplay.h"
+
+
+DEFINE_STAT(STAT_AvatarSdk_HttpCacheHits);
+DEFINE_STAT(STAT_AvatarSdk_HttpCacheMisses);
+DEFINE_STAT(STAT_AvatarSdk_HttpCacheRevalidations);
+
+
+ItSeez3D::HttpCache & ItSeez3D::HttpCache::Get()
+{
+	static HttpCache cache;
+	return cache;
+}
+
+ItSeez3D::HttpCache::HttpCache()
+	: directory(EnsureDirectoryExists(FPaths::Combine(DownloadLocation(), TEXT("http_cache"))))
+{
+	Load();
+}
+
+void ItSeez3D::HttpCache::AddValidators(const TSharedRef<IHttpRequest> &request)
+{
+	// bodies may be evicted from the asset cache, the request stays unconditional then
+	const auto *entry = entries.Find(request->GetURL());
+	if (!entry || !AssetCache::Get().Contains(BodyName(request->GetURL())))
+		return;
+
+	if (!entry->eTag.IsEmpty())
+		request->SetHeader(TEXT("If-None-Match"), entry->eTag);
+	if (!entry->lastModified.IsEmpty())
+		request->SetHeader(TEXT("If-Modified-Since"), entry->lastModified);
+	INC_DWORD_STAT(STAT_AvatarSdk_HttpCacheRevalidations);
+}
+
+void ItSeez3D::HttpCache::Resolve(FHttpResponsePtr response, const FOnResponseResolved &onResolved)
+{
+	if (!response.IsValid())
+	{
+		onResolved(response);
+		return;
+	}
+
+	const auto url = response->GetURL();
+	const auto code = response->GetResponseCode();
+	if (code == EHttpResponseCodes::NotModified)
+	{
+		AssetCache::Get().LoadAsync(BodyName(url), [this, url, onResolved](const FFileBytes &body)
+		{
+			const auto *entry = entries.Find(url);
+			if (!entry || !body.IsValid())
+			{
+				UE_LOG(LogAvatarSdk, Warning, TEXT("Not modified, but no stored body for %s, requesting it again"), *url);
+				entries.Remove(url);
+				Save();
+				Refetch(url, onResolved);
+				return;
+			}
+
+			INC_DWORD_STAT(STAT_AvatarSdk_HttpCacheHits);
+			UE_LOG(LogAvatarSdk, Log, TEXT("Not modified, %d bytes served from cache for %s"), body->Num(), *url);
+			const TMap<FString, FString> headers = { { TEXT("Content-Type"), entry->contentType } };
+
+			// nobody else holds the loaded buffer
+			onResolved(MakeShareable(new StoredHttpResponse(url, EHttpResponseCodes::Ok, headers, MoveTemp(*body))));
+		});
+		return;
+	}
+
+	if (code == EHttpResponseCodes::Ok)
+	{
+		Entry entry;
+		entry.eTag = response->GetHeader(TEXT("ETag"));
+		entry.lastModified = response->GetHeader(TEXT("Last-Modified"));
+		entry.contentType = response->GetContentType();
+		if (!entry.eTag.IsEmpty() || !entry.lastModified.IsEmpty())
+		{
+			INC_DWORD_STAT(STAT_AvatarSdk_HttpCacheMisses);
+			StoreEntry(url, entry, CopyBytes(response->GetContent()));
+		}
+	}
+	onResolved(response);
+}
+
+void ItSeez3D::HttpCache::Refetch(const FString &url, const FOnResponseResolved &onResolved)
+{
+	// the entry is gone, so the request is unconditional and can't be answered with 304 again
+	SendAuthorized(GetRequest(url, AuthSession::Get().GetCredentials()), [this, onResolved](FHttpResponsePtr response, bool bWasSuccessful)
+	{
+		if (!bWasSuccessful || !response.IsValid() || response->GetResponseCode() == EHttpResponseCodes::NotModified)
+		{
+			onResolved(FHttpResponsePtr());
+			return;
+		}
+		Resolve(response, onResolved);
+	});
+}
+
+void ItSeez3D::HttpCache::Store(const FString &url, const FString &eTag, const FString &lastModified, const FFileBytes &body)
+{
+	if (eTag.IsEmpty() && lastModified.IsEmpty())
+		return;
+
+	Entry entry;
+	entry.eTag = eTag;
+	entry.lastModified = lastModified;
+	INC_DWORD_STAT(STAT_AvatarSdk_HttpCacheMisses);
+	StoreEntry(url, entry, body);
+}
+
+void ItSeez3D::HttpCache::Remove(const FString &url)
+{
+	if (entries.Remove(url) == 0)
+		return;
+
+	AssetCache::Get().Remove(BodyName(url));
+	Save();
+}
+
+void ItSeez3D::HttpCache::StoreEntry(const FString &url, const Entry &entry, const FFileBytes &body)
+{
+	AssetCache::Get().Put(BodyName(url), body, [this, url, entry](bool bStored)
+	{
+		if (!bStored)
+		{
+			UE_LOG(LogAvatarSdk, Warning, TEXT("Unable to store response of %s"), *url);
+			return;
+		}
+
+		entries.Add(url, entry);
+		Save();
+	});
+}
+
+FString ItSeez3D::HttpCache::BodyName(const FString &url)
+{
+	return TEXT("http/") + url;
+}
+
+void ItSeez3D::HttpCache::Load()
+{
+	FString text;
+	if (!FFileHelper::LoadFileToString(text, *FPaths::Combine(directory, TEXT("index.json")), FILEREAD_Silent))
+		return;
+
+	TSharedPtr<FJsonObject> json;
+	auto reader = TJsonReaderFactory<>::Create(text);
+	if (!FJsonSerializer::Deserialize(reader, json) || !json.IsValid())
+	{
+		UE_LOG(LogAvatarSdk, Warning, TEXT("Http cache index is damaged, starting with empty cache"));
+		return;
+	}
+
+	for (const auto &field : json->Values)
+	{
+		const auto object = field.Value->AsObject();
+		if (!object.IsValid())
+			continue;
+
+		Entry entry;
+		object->TryGetStringField("etag", entry.eTag);
+		object->TryGetStringField("last_modified", entry.lastModified);
+		object->TryGetStringField("content_type", entry.contentType);
+		entries.Add(field.Key, entry);
+	}
+	UE_LOG(LogAvatarSdk, Log, TEXT("Http cache has %d entries"), entries.Num());
+}
+
+void ItSeez3D::HttpCache::Save() const
+{
+	TSharedRef<FJsonObject> json = MakeShareable(new FJsonObject());
+	for (const auto &pair : entries)
+	{
+		TSharedRef<FJsonObject> object = MakeShareable(new FJsonObject());
+		object->SetStringField("etag", pair.Value.eTag);
+		object->SetStringField("last_modified", pair.Value.lastModified);
+		object->SetStringField("content_type", pair.Value.contentType);
+		json->SetObjectField(pair.Key, object);
+	}
+
+	FString text;
+	auto writer = TJsonWriterFactory<>::Create(&text);
+	FJsonSerializer::Serialize(json, writer);
+
+	const FTCHARToUTF8 utf8(*text);
+	TArray<uint8> bytes((const uint8 *)utf8.Get(), utf8.Length());
+	SaveFileAsync(FPaths::Combine(directory, TEXT("index.json")), MoveTemp(bytes), [](bool bSaved)
+	{
+		if (!bSaved)
+			UE_LOG(LogAvatarSdk, Warning, TEXT("Unable to save http cache index"));
+	});
+}
@@ -0,0 +1,67 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "Runtime/Online/HTTP/Public/Http.h"
+
+#include "AsyncFileIO.h"
+
+
+namespace ItSeez3D
+{
+	/// Called on the game thread with the resolved response.
+	typedef TFunction<void(FHttpResponsePtr)> FOnResponseResolved;
+
+	/// Bodies of GET responses that carry ETag or Last-Modified, stored in the AssetCache, and their validators.
+	/// GetRequest sends If-None-Match / If-Modified-Since for the urls stored here, and Resolve answers
+	/// "304 Not Modified" with the stored body, loaded on a worker thread. Urls get here only through Resolve or Store,
+	/// so the requests of handlers that don't resolve their responses are never conditional.
+	class HttpCache
+	{
+	public:
+		static HttpCache & Get();
+
+		void AddValidators(const TSharedRef<IHttpRequest> &request);
+
+		/// 200 responses with validators are stored. A 304 response is replaced by a 200 response with the stored body.
+		/// If that is missing or damaged the entry is dropped and the url is requested again without validators,
+		/// a null response means that request failed. Only a 304 response is resolved later.
+		void Resolve(FHttpResponsePtr response, const FOnResponseResolved &onResolved);
+
+		/// For bodies assembled from several responses, e.g. Range chunks.
+		void Store(const FString &url, const FString &eTag, const FString &lastModified, const FFileBytes &body);
+
+		/// Forgets the url, e.g. an archive whose entries are cached on their own.
+		void Remove(const FString &url);
+
+	private:
+		struct Entry
+		{
+			FString eTag, lastModified;
+			FString contentType;
+		};
+
+		HttpCache();
+
+		void Refetch(const FString &url, const FOnResponseResolved &onResolved);
+		void StoreEntry(const FString &url, const Entry &entry, const FFileBytes &body);
+		static FString BodyName(const FString &url);
+
+		void Load();
+		void Save() const;
+
+	private:
+		FString directory;
+		TMap<FString, Entry> entries;
+	};
+}
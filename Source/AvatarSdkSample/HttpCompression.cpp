@@ -0,0 +1,119 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#include "HttpCompression.h"
+
+#include "Misc/ConfigCacheIni.h"
+
+#include "zlib.h"
+
+#include "AvatarSdkSample.h"
+#include "AvatarSdkStats.h"
+#include "HttpRecordReplay.h"
+
+
+DEFINE_STAT(STAT_AvatarSdk_HttpWireKB);
+DEFINE_STAT(STAT_AvatarSdk_HttpDecodedKB);
+
+
+namespace
+{
+	// 15 + 32 detects zlib and gzip headers, -15 is raw deflate sent by some servers as "deflate"
+	bool Inflate(int windowBits, const TArray<uint8> &encoded, TArray<uint8> &decoded)
+	{
+		z_stream stream;
+		FMemory::Memzero(stream);
+		if (inflateInit2(&stream, windowBits) != Z_OK)
+			return false;
+
+		decoded.SetNumUninitialized(FMath::Max(4096, encoded.Num() * 4), false);
+		stream.next_in = const_cast<Bytef *>(encoded.GetData());
+		stream.avail_in = uInt(encoded.Num());
+
+		int result = Z_OK;
+		while (result == Z_OK)
+		{
+			if (stream.total_out == uLong(decoded.Num()))
+				decoded.SetNumUninitialized(decoded.Num() * 2, false);
+			stream.next_out = decoded.GetData() + stream.total_out;
+			stream.avail_out = uInt(decoded.Num() - stream.total_out);
+			result = inflate(&stream, Z_NO_FLUSH);
+		}
+
+		decoded.SetNum(int32(stream.total_out), false);
+		inflateEnd(&stream);
+		return result == Z_STREAM_END;
+	}
+}
+
+FString ItSeez3D::AcceptedEncodings()
+{
+	static const bool bAccept = []()
+	{
+		bool bValue = true;
+		if (GConfig)
+			GConfig->GetBool(configSection, TEXT("AcceptCompressedResponses"), bValue, GGameIni);
+		return bValue;
+	}();
+	return bAccept ? TEXT("gzip, deflate") : FString();
+}
+
+bool ItSeez3D::DecodeBody(const FString &contentEncoding, const TArray<uint8> &encoded, TArray<uint8> &decoded)
+{
+	if (contentEncoding.IsEmpty() || contentEncoding.Equals(TEXT("identity"), ESearchCase::IgnoreCase))
+	{
+		decoded = encoded;
+		return true;
+	}
+
+	if (contentEncoding.Equals(TEXT("gzip"), ESearchCase::IgnoreCase) || contentEncoding.Equals(TEXT("x-gzip"), ESearchCase::IgnoreCase))
+		return Inflate(15 + 32, encoded, decoded);
+	if (contentEncoding.Equals(TEXT("deflate"), ESearchCase::IgnoreCase))
+		return Inflate(15 + 32, encoded, decoded) || Inflate(-15, encoded, decoded);
+
+	UE_LOG(LogAvatarSdk, Warning, TEXT("Unsupported content encoding %s"), *contentEncoding);
+	return false;
+}
+
+FHttpResponsePtr ItSeez3D::DecodeResponse(FHttpResponsePtr response)
+{
+	if (!response.IsValid() || response->GetResponseCode() == 206)
+		return response;
+
+	const auto &encoded = response->GetContent();
+	const FString encoding = response->GetHeader(TEXT("Content-Encoding")).Trim().TrimTrailing();
+	INC_DWORD_STAT_BY(STAT_AvatarSdk_HttpWireKB, uint32(encoded.Num() / 1024));
+	if (encoding.IsEmpty() || encoding.Equals(TEXT("identity"), ESearchCase::IgnoreCase))
+	{
+		INC_DWORD_STAT_BY(STAT_AvatarSdk_HttpDecodedKB, uint32(encoded.Num() / 1024));
+		return response;
+	}
+
+	TArray<uint8> decoded;
+	if (!DecodeBody(encoding, encoded, decoded))
+	{
+		UE_LOG(LogAvatarSdk, Warning, TEXT("Unable to decode %s response of %s"), *encoding, *response->GetURL());
+		return response;
+	}
+	INC_DWORD_STAT_BY(STAT_AvatarSdk_HttpDecodedKB, uint32(decoded.Num() / 1024));
+	UE_LOG(LogAvatarSdk, Log, TEXT("%s: %d bytes over the wire, %d decoded (%s)"), *response->GetURL(), encoded.Num(), decoded.Num(), *encoding);
+
+	TMap<FString, FString> headers;
+	for (const auto &line : response->GetAllHeaders())
+	{
+		FString name, value;
+		if (!line.Split(TEXT(":"), &name, &value))
+			continue;
+		name = name.Trim().TrimTrailing();
+		if (!name.Equals(TEXT("Content-Encoding"), ESearchCase::IgnoreCase) && !name.Equals(TEXT("Content-Length"), ESearchCase::IgnoreCase))
+			headers.Add(name, value.Trim().TrimTrailing());
+	}
+	return MakeShareable(new StoredHttpResponse(response->GetURL(), response->GetResponseCode(), headers, MoveTemp(decoded)));
+}
@@ -0,0 +1,29 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "Runtime/Online/HTTP/Public/Http.h"
+
+
+namespace ItSeez3D
+{
+	/// Accept-Encoding sent with every request, empty if AcceptCompressedResponses is off in the game config.
+	FString AcceptedEncodings();
+
+	/// Inflates a "gzip" or "deflate" body, an empty or "identity" encoding is copied as is.
+	bool DecodeBody(const FString &contentEncoding, const TArray<uint8> &encoded, TArray<uint8> &decoded);
+
+	/// Returns a decoded copy of a compressed response and counts wire and decoded bytes.
+	/// Partial content is returned as is: ranges of a compressed asset are decoded together once complete.
+	FHttpResponsePtr DecodeResponse(FHttpResponsePtr response);
+}
@@ -0,0 +1,368 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#include "HttpRecordReplay.h"
+
+#include "Paths.h"
+#include "Containers/Ticker.h"
+#include "Misc/ConfigCacheIni.h"
+#include "Misc/FileHelper.h"
+#include "Misc/SecureHash.h"
+
+#include "Runtime/Json/Public/Json.h"
+
+#include "AvatarApi.h"
+#include "AvatarSdkSample.h"
+#include "HttpCompression.h"
+
+
+namespace
+{
+	// headers are stored and reported as "Name: value"
+	bool SplitHeader(const FString &line, FString &name, FString &value)
+	{
+		if (!line.Split(TEXT(":"), &name, &value))
+			return false;
+		name = name.Trim().TrimTrailing();
+		value = value.Trim().TrimTrailing();
+		return true;
+	}
+
+	TArray<FString> JoinHeaders(const TMap<FString, FString> &headers)
+	{
+		TArray<FString> lines;
+		for (const auto &pair : headers)
+			lines.Add(pair.Key + TEXT(": ") + pair.Value);
+		return lines;
+	}
+
+	FString FindHeader(const TMap<FString, FString> &headers, const FString &headerName)
+	{
+		for (const auto &pair : headers)
+		{
+			if (pair.Key.Equals(headerName, ESearchCase::IgnoreCase))
+				return pair.Value;
+		}
+		return FString();
+	}
+
+	FString FindUrlParameter(const FString &url, const FString &parameterName)
+	{
+		FString path, query;
+		if (!url.Split(TEXT("?"), &path, &query))
+			return FString();
+
+		TArray<FString> parameters;
+		query.ParseIntoArray(parameters, TEXT("&"));
+		for (const auto &parameter : parameters)
+		{
+			FString name, value;
+			if (parameter.Split(TEXT("="), &name, &value) && name == parameterName)
+				return value;
+		}
+		return FString();
+	}
+
+	// credentials differ between sessions, so only the verb, the url and the range identify a request
+	FString FixtureKey(const TSharedRef<IHttpRequest> &request)
+	{
+		return FMD5::HashAnsiString(*(request->GetVerb() + TEXT(" ") + request->GetURL() + TEXT(" ") + request->GetHeader(TEXT("Range"))));
+	}
+}
+
+ItSeez3D::HttpMode ItSeez3D::GetHttpMode()
+{
+	static const HttpMode mode = []()
+	{
+		FString value;
+		if (GConfig)
+			GConfig->GetString(configSection, TEXT("HttpMode"), value, GGameIni);
+
+		if (value == TEXT("Record"))
+			return HttpMode::RECORD;
+		if (value == TEXT("Replay"))
+			return HttpMode::REPLAY;
+		if (!value.IsEmpty() && value != TEXT("Live"))
+			UE_LOG(LogAvatarSdk, Warning, TEXT("Unknown HttpMode %s, using live requests"), *value);
+		return HttpMode::LIVE;
+	}();
+	return mode;
+}
+
+TSharedRef<IHttpRequest> ItSeez3D::CreateHttpRequest()
+{
+	TSharedRef<IHttpRequest> request = FHttpModule::Get().CreateRequest();
+	switch (GetHttpMode())
+	{
+	case HttpMode::RECORD:
+		// fixtures keep the responses as they came over the wire
+		request = MakeShareable(new WrappedHttpRequest(request, [](const TSharedRef<IHttpRequest> &recorded, FHttpResponsePtr response, bool bWasSuccessful)
+		{
+			if (bWasSuccessful)
+				HttpFixtures::Get().Record(recorded, response);
+			return response;
+		}));
+		break;
+	case HttpMode::REPLAY:
+		request = MakeShareable(new ReplayHttpRequest());
+		break;
+	default:
+		break;
+	}
+
+	const FString encodings = AcceptedEncodings();
+	if (encodings.IsEmpty())
+		return request;
+
+	request->SetHeader(TEXT("Accept-Encoding"), encodings);
+	return MakeShareable(new WrappedHttpRequest(request, [](const TSharedRef<IHttpRequest> &, FHttpResponsePtr response, bool)
+	{
+		return DecodeResponse(response);
+	}));
+}
+
+ItSeez3D::StoredHttpResponse::StoredHttpResponse(const FString &url, int32 code, const TMap<FString, FString> &headers, TArray<uint8> &&content)
+	: url(url)
+	, code(code)
+	, headers(headers)
+	, content(MoveTemp(content))
+{
+}
+
+FString ItSeez3D::StoredHttpResponse::GetURLParameter(const FString &parameterName)
+{
+	return FindUrlParameter(url, parameterName);
+}
+
+FString ItSeez3D::StoredHttpResponse::GetHeader(const FString &headerName)
+{
+	return FindHeader(headers, headerName);
+}
+
+TArray<FString> ItSeez3D::StoredHttpResponse::GetAllHeaders()
+{
+	return JoinHeaders(headers);
+}
+
+FString ItSeez3D::StoredHttpResponse::GetContentAsString()
+{
+	const FUTF8ToTCHAR text((const ANSICHAR *)content.GetData(), content.Num());
+	return FString(text.Length(), text.Get());
+}
+
+ItSeez3D::HttpFixtures & ItSeez3D::HttpFixtures::Get()
+{
+	static HttpFixtures fixtures;
+	return fixtures;
+}
+
+ItSeez3D::HttpFixtures::HttpFixtures()
+{
+	int32 latencyMs = 0, bandwidthKBps = 0;
+	if (GConfig)
+	{
+		GConfig->GetString(configSection, TEXT("HttpFixtureDir"), directory, GGameIni);
+		GConfig->GetInt(configSection, TEXT("ReplayLatencyMs"), latencyMs, GGameIni);
+		GConfig->GetInt(configSection, TEXT("ReplayBandwidthKBps"), bandwidthKBps, GGameIni);
+	}
+	if (directory.IsEmpty())
+		directory = FPaths::Combine(FPaths::GameSavedDir(), TEXT("HttpFixtures"));
+	else if (FPaths::IsRelative(directory))
+		directory = FPaths::Combine(FPaths::GameDir(), directory);
+
+	latencySeconds = FMath::Max(0, latencyMs) / 1000.0f;
+	bytesPerSecond = FMath::Max(0, bandwidthKBps) * 1024.0f;
+	UE_LOG(LogAvatarSdk, Log, TEXT("Http fixtures in %s, replay latency %d ms, bandwidth %d KB/s"), *directory, latencyMs, bandwidthKBps);
+}
+
+void ItSeez3D::HttpFixtures::Record(const TSharedRef<IHttpRequest> &request, FHttpResponsePtr response)
+{
+	if (!response.IsValid())
+		return;
+
+	const auto key = FixtureKey(request);
+	const int32 index = recordCounts.FindOrAdd(key)++;
+
+	TSharedRef<FJsonObject> json = MakeShareable(new FJsonObject());
+	json->SetStringField("verb", request->GetVerb());
+	json->SetStringField("url", request->GetURL());
+	json->SetNumberField("code", response->GetResponseCode());
+	TArray<TSharedPtr<FJsonValue>> headers;
+	for (const auto &header : response->GetAllHeaders())
+		headers.Add(MakeShareable(new FJsonValueString(header)));
+	json->SetArrayField("headers", headers);
+
+	FString text;
+	auto writer = TJsonWriterFactory<>::Create(&text);
+	FJsonSerializer::Serialize(json, writer);
+
+	EnsureDirectoryExists(directory);
+	if (!FFileHelper::SaveStringToFile(text, *FixturePath(key, index, TEXT(".json"))) ||
+		!FFileHelper::SaveArrayToFile(response->GetContent(), *FixturePath(key, index, TEXT(".bin"))))
+	{
+		UE_LOG(LogAvatarSdk, Warning, TEXT("Unable to record %s %s"), *request->GetVerb(), *request->GetURL());
+		return;
+	}
+	UE_LOG(LogAvatarSdk, Log, TEXT("Recorded %s %s #%d, code %d, %d bytes"), *request->GetVerb(), *request->GetURL(), index,
+		response->GetResponseCode(), response->GetContent().Num());
+}
+
+FHttpResponsePtr ItSeez3D::HttpFixtures::Replay(const TSharedRef<IHttpRequest> &request)
+{
+	const auto key = FixtureKey(request);
+	int32 &next = replayCounts.FindOrAdd(key);
+	int32 index = next;
+	if (FPaths::FileExists(FixturePath(key, index, TEXT(".json"))))
+		++next;
+	else
+		--index;
+
+	FString text;
+	TArray<uint8> content;
+	if (index < 0 || !FFileHelper::LoadFileToString(text, *FixturePath(key, index, TEXT(".json"))) ||
+		!FFileHelper::LoadFileToArray(content, *FixturePath(key, index, TEXT(".bin"))))
+	{
+		UE_LOG(LogAvatarSdk, Warning, TEXT("No fixture for %s %s"), *request->GetVerb(), *request->GetURL());
+		return nullptr;
+	}
+
+	TSharedPtr<FJsonObject> json;
+	auto reader = TJsonReaderFactory<>::Create(text);
+	if (!FJsonSerializer::Deserialize(reader, json) || !json.IsValid())
+	{
+		UE_LOG(LogAvatarSdk, Warning, TEXT("Fixture %s is damaged"), *FixturePath(key, index, TEXT(".json")));
+		return nullptr;
+	}
+
+	TMap<FString, FString> headers;
+	const TArray<TSharedPtr<FJsonValue>> *headerLines = nullptr;
+	if (json->TryGetArrayField("headers", headerLines))
+	{
+		for (const auto &line : *headerLines)
+		{
+			FString name, value;
+			if (SplitHeader(line->AsString(), name, value))
+				headers.Add(name, value);
+		}
+	}
+
+	const int32 code = int32(json->GetNumberField("code"));
+	return MakeShareable(new StoredHttpResponse(request->GetURL(), code, headers, MoveTemp(content)));
+}
+
+float ItSeez3D::HttpFixtures::ReplayDelay(int32 bytes) const
+{
+	return latencySeconds + (bytesPerSecond > 0 ? bytes / bytesPerSecond : 0);
+}
+
+FString ItSeez3D::HttpFixtures::FixturePath(const FString &key, int32 index, const TCHAR *extension) const
+{
+	return FPaths::Combine(directory, FString::Printf(TEXT("%s_%d%s"), *key, index, extension));
+}
+
+ItSeez3D::WrappedHttpRequest::WrappedHttpRequest(const TSharedRef<IHttpRequest> &inner, const FHttpResponseFilter &filter)
+	: inner(inner)
+	, filter(filter)
+{
+}
+
+bool ItSeez3D::WrappedHttpRequest::ProcessRequest()
+{
+	// the http module keeps only the inner request, this one stays alive until it completes
+	keepAlive = AsShared();
+	response.Reset();
+	inner->OnRequestProgress().BindLambda([this](FHttpRequestPtr, int32 bytesSent, int32 bytesReceived)
+	{
+		onProgress.ExecuteIfBound(AsShared(), bytesSent, bytesReceived);
+	});
+	inner->OnProcessRequestComplete().BindLambda([this](FHttpRequestPtr, FHttpResponsePtr innerResponse, bool bWasSuccessful)
+	{
+		const TSharedRef<IHttpRequest> self = keepAlive.ToSharedRef();
+		keepAlive.Reset();
+		response = filter(self, innerResponse, bWasSuccessful);
+		onComplete.ExecuteIfBound(self, response, bWasSuccessful);
+	});
+	return inner->ProcessRequest();
+}
+
+FString ItSeez3D::ReplayHttpRequest::GetURLParameter(const FString &parameterName)
+{
+	return FindUrlParameter(url, parameterName);
+}
+
+FString ItSeez3D::ReplayHttpRequest::GetHeader(const FString &headerName)
+{
+	return FindHeader(headers, headerName);
+}
+
+TArray<FString> ItSeez3D::ReplayHttpRequest::GetAllHeaders()
+{
+	return JoinHeaders(headers);
+}
+
+void ItSeez3D::ReplayHttpRequest::SetContentAsString(const FString &contentString)
+{
+	const FTCHARToUTF8 utf8(*contentString);
+	content.Reset(utf8.Length());
+	content.Append((const uint8 *)utf8.Get(), utf8.Length());
+}
+
+void ItSeez3D::ReplayHttpRequest::AppendToHeader(const FString &headerName, const FString &additionalHeaderValue)
+{
+	FString &value = headers.FindOrAdd(headerName);
+	value = value.IsEmpty() ? additionalHeaderValue : value + TEXT(", ") + additionalHeaderValue;
+}
+
+bool ItSeez3D::ReplayHttpRequest::ProcessRequest()
+{
+	if (status == EHttpRequestStatus::Processing)
+		return false;
+
+	// the response is looked up now, so requests consume the recorded sequence in the order they were sent
+	const TSharedRef<IHttpRequest> self = AsShared();
+	response = HttpFixtures::Get().Replay(self);
+	const int32 bytes = content.Num() + (response.IsValid() ? response->GetContent().Num() : 0);
+
+	status = EHttpRequestStatus::Processing;
+	startTime = FPlatformTime::Seconds();
+	tickHandle = FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateLambda([this, self](float)
+	{
+		Complete();
+		return false;
+	}), HttpFixtures::Get().ReplayDelay(bytes));
+	return true;
+}
+
+void ItSeez3D::ReplayHttpRequest::CancelRequest()
+{
+	if (status != EHttpRequestStatus::Processing)
+		return;
+
+	const TSharedRef<IHttpRequest> self = AsShared();
+	FTicker::GetCoreTicker().RemoveTicker(tickHandle);
+	tickHandle.Reset();
+	response.Reset();
+	Complete();
+}
+
+float ItSeez3D::ReplayHttpRequest::GetElapsedTime()
+{
+	return startTime > 0 ? float(FPlatformTime::Seconds() - startTime) : 0;
+}
+
+void ItSeez3D::ReplayHttpRequest::Complete()
+{
+	tickHandle.Reset();
+	const bool bSucceeded = response.IsValid();
+	status = bSucceeded ? EHttpRequestStatus::Succeeded : EHttpRequestStatus::Failed;
+	if (bSucceeded)
+		onProgress.ExecuteIfBound(AsShared(), content.Num(), response->GetContent().Num());
+	onComplete.ExecuteIfBound(AsShared(), response, bSucceeded);
+}
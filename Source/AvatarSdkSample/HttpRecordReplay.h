@@ -0,0 +1,169 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "Runtime/Online/HTTP/Public/Http.h"
+
+
+namespace ItSeez3D
+{
+	/// HttpMode in the game config: "Live" (default), "Record" or "Replay".
+	enum class HttpMode
+	{
+		LIVE,
+		RECORD,
+		REPLAY,
+	};
+
+	HttpMode GetHttpMode();
+
+	/// Live, recording or replaying request depending on the HttpMode, decoding compressed responses.
+	TSharedRef<IHttpRequest> CreateHttpRequest();
+
+	/// Response with the code, headers and body held in memory.
+	class StoredHttpResponse : public IHttpResponse
+	{
+	public:
+		StoredHttpResponse(const FString &url, int32 code, const TMap<FString, FString> &headers, TArray<uint8> &&content);
+
+		virtual FString GetURL() override { return url; }
+		virtual FString GetURLParameter(const FString &parameterName) override;
+		virtual FString GetHeader(const FString &headerName) override;
+		virtual TArray<FString> GetAllHeaders() override;
+		virtual FString GetContentType() override { return GetHeader(TEXT("Content-Type")); }
+		virtual int32 GetContentLength() override { return content.Num(); }
+		virtual const TArray<uint8> & GetContent() override { return content; }
+		virtual int32 GetResponseCode() override { return code; }
+		virtual FString GetContentAsString() override;
+
+	private:
+		FString url;
+		int32 code;
+		TMap<FString, FString> headers;
+		TArray<uint8> content;
+	};
+
+	/// Request/response pairs stored in HttpFixtureDir. Requests with the same verb, url and range are numbered
+	/// in the order they were sent, so repeated status polls replay the recorded progress. After the last recorded
+	/// response of a request the last one is repeated.
+	class HttpFixtures
+	{
+	public:
+		static HttpFixtures & Get();
+
+		void Record(const TSharedRef<IHttpRequest> &request, FHttpResponsePtr response);
+		FHttpResponsePtr Replay(const TSharedRef<IHttpRequest> &request);
+
+		/// Simulated network: ReplayLatencyMs per request plus the body at ReplayBandwidthKBps (zero means unlimited).
+		float ReplayDelay(int32 bytes) const;
+
+	private:
+		HttpFixtures();
+
+		FString FixturePath(const FString &key, int32 index, const TCHAR *extension) const;
+
+	private:
+		FString directory;
+		float latencySeconds = 0;
+		float bytesPerSecond = 0;
+		TMap<FString, int32> recordCounts, replayCounts;
+	};
+
+	/// Replaces the response of a completed request, e.g. with a decoded one.
+	typedef TFunction<FHttpResponsePtr(const TSharedRef<IHttpRequest> &, FHttpResponsePtr, bool)> FHttpResponseFilter;
+
+	/// Sends the request it wraps and passes the response through the filter before the completion delegate fires.
+	class WrappedHttpRequest : public IHttpRequest
+	{
+	public:
+		WrappedHttpRequest(const TSharedRef<IHttpRequest> &inner, const FHttpResponseFilter &filter);
+
+		virtual FString GetURL() override { return inner->GetURL(); }
+		virtual FString GetURLParameter(const FString &parameterName) override { return inner->GetURLParameter(parameterName); }
+		virtual FString GetHeader(const FString &headerName) override { return inner->GetHeader(headerName); }
+		virtual TArray<FString> GetAllHeaders() override { return inner->GetAllHeaders(); }
+		virtual FString GetContentType() override { return inner->GetContentType(); }
+		virtual int32 GetContentLength() override { return inner->GetContentLength(); }
+		virtual const TArray<uint8> & GetContent() override { return inner->GetContent(); }
+
+		virtual FString GetVerb() override { return inner->GetVerb(); }
+		virtual void SetVerb(const FString &verb) override { inner->SetVerb(verb); }
+		virtual void SetURL(const FString &url) override { inner->SetURL(url); }
+		virtual void SetContent(const TArray<uint8> &contentPayload) override { inner->SetContent(contentPayload); }
+		virtual void SetContentAsString(const FString &contentString) override { inner->SetContentAsString(contentString); }
+		virtual void SetHeader(const FString &headerName, const FString &headerValue) override { inner->SetHeader(headerName, headerValue); }
+		virtual void AppendToHeader(const FString &headerName, const FString &additionalHeaderValue) override { inner->AppendToHeader(headerName, additionalHeaderValue); }
+		virtual bool ProcessRequest() override;
+		virtual FHttpRequestCompleteDelegate & OnProcessRequestComplete() override { return onComplete; }
+		virtual FHttpRequestProgressDelegate & OnRequestProgress() override { return onProgress; }
+		virtual void CancelRequest() override { inner->CancelRequest(); }
+		virtual EHttpRequestStatus::Type GetStatus() override { return inner->GetStatus(); }
+		virtual const FHttpResponsePtr GetResponse() const override { return response.IsValid() ? response : inner->GetResponse(); }
+		virtual void Tick(float deltaSeconds) override {}
+		virtual float GetElapsedTime() override { return inner->GetElapsedTime(); }
+
+	private:
+		TSharedRef<IHttpRequest> inner;
+		FHttpResponseFilter filter;
+		FHttpResponsePtr response;
+		TSharedPtr<IHttpRequest> keepAlive;
+		FHttpRequestCompleteDelegate onComplete;
+		FHttpRequestProgressDelegate onProgress;
+	};
+
+	/// Answers from the fixtures after the simulated network delay, fails if nothing was recorded for the request.
+	class ReplayHttpRequest : public IHttpRequest
+	{
+	public:
+		virtual FString GetURL() override { return url; }
+		virtual FString GetURLParameter(const FString &parameterName) override;
+		virtual FString GetHeader(const FString &headerName) override;
+		virtual TArray<FString> GetAllHeaders() override;
+		virtual FString GetContentType() override { return GetHeader(TEXT("Content-Type")); }
+		virtual int32 GetContentLength() override { return content.Num(); }
+		virtual const TArray<uint8> & GetContent() override { return content; }
+
+		virtual FString GetVerb() override { return verb; }
+		virtual void SetVerb(const FString &newVerb) override { verb = newVerb; }
+		virtual void SetURL(const FString &newUrl) override { url = newUrl; }
+		virtual void SetContent(const TArray<uint8> &contentPayload) override { content = contentPayload; }
+		virtual void SetContentAsString(const FString &contentString) override;
+		virtual void SetHeader(const FString &headerName, const FString &headerValue) override { headers.Add(headerName, headerValue); }
+		virtual void AppendToHeader(const FString &headerName, const FString &additionalHeaderValue) override;
+		virtual bool ProcessRequest() override;
+		virtual FHttpRequestCompleteDelegate & OnProcessRequestComplete() override { return onComplete; }
+		virtual FHttpRequestProgressDelegate & OnRequestProgress() override { return onProgress; }
+		virtual void CancelRequest() override;
+		virtual EHttpRequestStatus::Type GetStatus() override { return status; }
+		virtual const FHttpResponsePtr GetResponse() const override { return response; }
+		virtual void Tick(float deltaSeconds) override {}
+		virtual float GetElapsedTime() override;
+
+	private:
+		void Complete();
+
+	private:
+		FString verb = TEXT("GET");
+		FString url;
+		TMap<FString, FString> headers;
+		TArray<uint8> content;
+
+		EHttpRequestStatus::Type status = EHttpRequestStatus::NotStarted;
+		FHttpResponsePtr response;
+		double startTime = 0;
+		FDelegateHandle tickHandle;
+
+		FHttpRequestCompleteDelegate onComplete;
+		FHttpRequestProgressDelegate onProgress;
+	};
+}
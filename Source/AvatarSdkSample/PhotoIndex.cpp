@@ -0,0 +1,124 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#include "PhotoIndex.h"
+
+#include "Paths.h"
+#include "Misc/FileHelper.h"
+#include "Misc/SecureHash.h"
+
+#include "Runtime/Json/Public/Json.h"
+
+#include "AsyncFileIO.h"
+#include "AvatarApi.h"
+#include "AvatarSdkSample.h"
+
+
+namespace
+{
+	FString IndexPath()
+	{
+		return FPaths::Combine(ItSeez3D::DownloadLocation(), TEXT("photos.json"));
+	}
+}
+
+ItSeez3D::PhotoIndex & ItSeez3D::PhotoIndex::Get()
+{
+	static PhotoIndex index;
+	return index;
+}
+
+ItSeez3D::PhotoIndex::PhotoIndex()
+{
+	Load();
+}
+
+FString ItSeez3D::PhotoIndex::PhotoKey(const uint8 *data, int64 size, const TMap<FString, FString> &parameters)
+{
+	FSHA1 sha;
+	const FTCHARToUTF8 account(*ClientId());
+	sha.Update((const uint8 *)account.Get(), account.Length());
+	sha.Update(data, uint32(size));
+
+	TArray<FString> names;
+	parameters.GenerateKeyArray(names);
+	names.Sort();
+	for (const auto &name : names)
+	{
+		const FTCHARToUTF8 field(*FString::Printf(TEXT("\n%s=%s"), *name, *parameters[name]));
+		sha.Update((const uint8 *)field.Get(), field.Length());
+	}
+	sha.Final();
+
+	uint8 digest[20];
+	sha.GetHash(digest);
+	return BytesToHex(digest, sizeof(digest));
+}
+
+FString ItSeez3D::PhotoIndex::FindAvatar(const FString &photoKey) const
+{
+	const FString *code = avatars.Find(photoKey);
+	return code ? *code : FString();
+}
+
+void ItSeez3D::PhotoIndex::Add(const FString &photoKey, const FString &avatarCode)
+{
+	avatars.Add(photoKey, avatarCode);
+	Save();
+}
+
+void ItSeez3D::PhotoIndex::RemoveAvatar(const FString &avatarCode)
+{
+	bool bRemoved = false;
+	for (auto it = avatars.CreateIterator(); it; ++it)
+	{
+		if (it.Value() == avatarCode)
+		{
+			it.RemoveCurrent();
+			bRemoved = true;
+		}
+	}
+
+	if (bRemoved)
+	{
+		UE_LOG(LogAvatarSdk, Log, TEXT("Avatar %s won't be reused, its photo will be uploaded again"), *avatarCode);
+		Save();
+	}
+}
+
+void ItSeez3D::PhotoIndex::Load()
+{
+	FString text;
+	if (!FFileHelper::LoadFileToString(text, *IndexPath(), FILEREAD_Silent))
+		return;
+
+	TSharedPtr<FJsonObject> json;
+	auto reader = TJsonReaderFactory<>::Create(text);
+	if (!FJsonSerializer::Deserialize(reader, json) || !json.IsValid())
+		return;
+
+	for (const auto &field : json->Values)
+		avatars.Add(field.Key, field.Value->AsString());
+}
+
+void ItSeez3D::PhotoIndex::Save() const
+{
+	TSharedRef<FJsonObject> json = MakeShareable(new FJsonObject());
+	for (const auto &pair : avatars)
+		json->SetStringField(pair.Key, pair.Value);
+
+	FString text;
+	auto writer = TJsonWriterFactory<>::Create(&text);
+	FJsonSerializer::Serialize(json, writer);
+
+	const FTCHARToUTF8 utf8(*text);
+	TArray<uint8> bytes((const uint8 *)utf8.Get(), utf8.Length());
+	SaveFileAsync(IndexPath(), MoveTemp(bytes));
+}
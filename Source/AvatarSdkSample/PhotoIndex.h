@@ -0,0 +1,45 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+
+namespace ItSeez3D
+{
+	/// Avatars generated before, keyed by the account, the uploaded photo and the generation parameters, so the same photo
+	/// is not uploaded and computed again. Stored in DownloadLocation()/photos.json.
+	class PhotoIndex
+	{
+	public:
+		static PhotoIndex & Get();
+
+		/// SHA1 of the client id, the photo bytes and the form fields sent with them. Safe to call on any thread.
+		static FString PhotoKey(const uint8 *data, int64 size, const TMap<FString, FString> &parameters);
+
+		/// Code of the avatar generated from the photo, empty if there is none.
+		FString FindAvatar(const FString &photoKey) const;
+
+		void Add(const FString &photoKey, const FString &avatarCode);
+
+		/// Call when the avatar failed or is gone from the server.
+		void RemoveAvatar(const FString &avatarCode);
+
+	private:
+		PhotoIndex();
+
+		void Load();
+		void Save() const;
+
+	private:
+		TMap<FString, FString> avatars;
+	};
+}
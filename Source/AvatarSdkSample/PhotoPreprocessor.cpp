@@ -0,0 +1,350 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#include "PhotoPreprocessor.h"
+
+#include "ModuleManager.h"
+#include "Async/Async.h"
+#include "Async/ParallelFor.h"
+#include "Misc/ConfigCacheIni.h"
+#include "Misc/FileHelper.h"
+
+#include "Runtime/ImageWrapper/Public/Interfaces/IImageWrapper.h"
+#include "Runtime/ImageWrapper/Public/Interfaces/IImageWrapperModule.h"
+
+#include "AvatarSdkSample.h"
+#include "AvatarSdkStats.h"
+#include "PhotoIndex.h"
+
+
+DECLARE_CYCLE_STAT(TEXT("Photo preprocessing"), STAT_AvatarSdk_PhotoPreprocess, STATGROUP_AvatarSdk);
+DEFINE_STAT(STAT_AvatarSdk_PhotoKBSaved);
+
+
+namespace
+{
+	int32 MaxPhotoDimension()
+	{
+		int32 maxDimension = 1280;
+		if (GConfig)
+			GConfig->GetInt(configSection, TEXT("PhotoMaxDimension"), maxDimension, GGameIni);
+		return maxDimension;
+	}
+
+	int32 JpegQuality()
+	{
+		int32 quality = 90;
+		if (GConfig)
+			GConfig->GetInt(configSection, TEXT("PhotoJpegQuality"), quality, GGameIni);
+		return FMath::Clamp(quality, 1, 100);
+	}
+
+	EImageFormat::Type DetectFormat(const uint8 *data, int64 size)
+	{
+		if (size > 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF)
+			return EImageFormat::JPEG;
+		if (size > 8 && data[0] == 0x89 && data[1] == 'P' && data[2] == 'N' && data[3] == 'G')
+			return EImageFormat::PNG;
+		return EImageFormat::Invalid;
+	}
+
+	uint32 ReadExifValue(const uint8 *p, int32 bytes, bool bBigEndian)
+	{
+		uint32 value = 0;
+		for (int32 i = 0; i < bytes; ++i)
+			value |= uint32(p[bBigEndian ? i : bytes - 1 - i]) << (8 * (bytes - 1 - i));
+		return value;
+	}
+
+	// EXIF Orientation tag of the JPEG, 1 (upright) if there is none
+	int32 JpegOrientation(const uint8 *data, int64 size)
+	{
+		int64 pos = 2;
+		while (pos + 4 <= size && data[pos] == 0xFF)
+		{
+			const uint8 marker = data[pos + 1];
+			const int64 length = ReadExifValue(data + pos + 2, 2, true);
+			// the EXIF block comes before the image data
+			if (marker == 0xDA || length < 2 || pos + 2 + length > size)
+				break;
+
+			const uint8 *segment = data + pos + 4;
+			const int64 segmentSize = length - 2;
+			if (marker == 0xE1 && segmentSize >= 14 && FMemory::Memcmp(segment, "Exif\0\0", 6) == 0)
+			{
+				const uint8 *tiff = segment + 6;
+				const int64 tiffSize = segmentSize - 6;
+				const bool bBigEndian = tiff[0] == 'M';
+				const int64 ifd = ReadExifValue(tiff + 4, 4, bBigEndian);
+				if (ifd + 2 > tiffSize)
+					return 1;
+
+				const int32 numEntries = ReadExifValue(tiff + ifd, 2, bBigEndian);
+				for (int32 i = 0; i < numEntries && ifd + 2 + (i + 1) * 12 <= tiffSize; ++i)
+				{
+					const uint8 *entry = tiff + ifd + 2 + i * 12;
+					if (ReadExifValue(entry, 2, bBigEndian) == 0x0112)
+					{
+						const int32 orientation = ReadExifValue(entry + 8, 2, bBigEndian);
+						return orientation >= 1 && orientation <= 8 ? orientation : 1;
+					}
+				}
+				return 1;
+			}
+			pos += 2 + length;
+		}
+		return 1;
+	}
+
+	// applies the EXIF orientation to BGRA8 pixels, orientations 5-8 swap width and height
+	void OrientBGRA(const TArray<uint8> &src, int32 &width, int32 &height, int32 orientation, TArray<uint8> &dst)
+	{
+		const int32 w = width, h = height;
+		const bool bTransposed = orientation >= 5;
+		const int32 dstW = bTransposed ? h : w, dstH = bTransposed ? w : h;
+		dst.SetNumUninitialized(src.Num());
+
+		const uint32 *srcPixels = (const uint32 *)src.GetData();
+		uint32 *dstPixels = (uint32 *)dst.GetData();
+		ParallelFor(dstH, [&](int32 y)
+		{
+			for (int32 x = 0; x < dstW; ++x)
+			{
+				int32 sx = x, sy = y;
+				switch (orientation)
+				{
+				case 2: sx = w - 1 - x; break;
+				case 3: sx = w - 1 - x; sy = h - 1 - y; break;
+				case 4: sy = h - 1 - y; break;
+				case 5: sx = y; sy = x; break;
+				case 6: sx = y; sy = h - 1 - x; break;
+				case 7: sx = w - 1 - y; sy = h - 1 - x; break;
+				case 8: sx = w - 1 - y; sy = x; break;
+				}
+				dstPixels[int64(y) * dstW + x] = srcPixels[int64(sy) * w + sx];
+			}
+		});
+
+		width = dstW;
+		height = dstH;
+	}
+
+	// source pixels covered by one destination pixel and their weights
+	struct Contribution
+	{
+		int32 first;
+		TArray<float> weights;
+	};
+
+	TArray<Contribution> BoxContributions(int32 srcSize, int32 dstSize)
+	{
+		const double scale = double(srcSize) / dstSize;
+		TArray<Contribution> contributions;
+		contributions.SetNum(dstSize);
+		for (int32 i = 0; i < dstSize; ++i)
+		{
+			const double begin = i * scale, end = (i + 1) * scale;
+			auto &c = contributions[i];
+			c.first = FMath::FloorToInt(begin);
+			const int32 last = FMath::Min(srcSize - 1, FMath::CeilToInt(end) - 1);
+			for (int32 s = c.first; s <= last; ++s)
+			{
+				const double overlap = FMath::Min<double>(end, s + 1) - FMath::Max<double>(begin, s);
+				c.weights.Add(float(overlap / scale));
+			}
+		}
+		return contributions;
+	}
+
+	struct PreprocessJob
+	{
+		FHttpResponsePtr response;
+		FString path;
+		TArray<uint8> fileBytes;
+		TArray<uint8> processed;
+		bool bProcessed = false;
+
+		// the photo key is hashed only if the job has them
+		TMap<FString, FString> keyParameters;
+		bool bNeedsKey = false;
+		FString photoKey;
+
+		const TArray<uint8> & Source() const
+		{
+			return response.IsValid() ? response->GetContent() : fileBytes;
+		}
+	};
+
+	void RunPreprocessJob(const TSharedRef<PreprocessJob, ESPMode::ThreadSafe> &job, const ItSeez3D::FOnPhotoReady &onReady)
+	{
+		// make sure the module is loaded on the game thread before worker threads use it
+		FModuleManager::LoadModuleChecked<IImageWrapperModule>(FName("ImageWrapper"));
+
+		Async<void>(EAsyncExecution::ThreadPool, [job, onReady]()
+		{
+			if (!job->path.IsEmpty() && !FFileHelper::LoadFileToArray(job->fileBytes, *job->path))
+				UE_LOG(LogAvatarSdk, Error, TEXT("Unable to read photo %s"), *job->path);
+
+			const auto &source = job->Source();
+			job->bProcessed = ItSeez3D::PreprocessPhoto(source.GetData(), source.Num(), job->processed);
+
+			const auto &bytes = job->bProcessed ? job->processed : source;
+			if (job->bNeedsKey && bytes.Num() > 0)
+				job->photoKey = ItSeez3D::PhotoIndex::PhotoKey(bytes.GetData(), bytes.Num(), job->keyParameters);
+
+			AsyncTask(ENamedThreads::GameThread, [job, onReady]()
+			{
+				const auto &bytes = job->bProcessed ? job->processed : job->Source();
+				onReady(bytes.GetData(), bytes.Num(), job->photoKey);
+			});
+		});
+	}
+}
+
+bool ItSeez3D::IsPhotoPreprocessingEnabled()
+{
+	return MaxPhotoDimension() > 0;
+}
+
+void ItSeez3D::ResizeBGRA(const uint8 *src, int32 srcWidth, int32 srcHeight, uint8 *dst, int32 dstWidth, int32 dstHeight)
+{
+	const auto columns = BoxContributions(srcWidth, dstWidth);
+	const auto rows = BoxContributions(srcHeight, dstHeight);
+
+	// horizontal pass into float BGRA, one pixel per vector register
+	TArray<float> tmp;
+	tmp.SetNumUninitialized(dstWidth * srcHeight * 4);
+	ParallelFor(srcHeight, [&](int32 y)
+	{
+		const uint8 *srcRow = src + int64(y) * srcWidth * 4;
+		float *tmpRow = tmp.GetData() + int64(y) * dstWidth * 4;
+		for (int32 x = 0; x < dstWidth; ++x)
+		{
+			const auto &c = columns[x];
+			VectorRegister acc = VectorZero();
+			for (int32 k = 0; k < c.weights.Num(); ++k)
+				acc = VectorMultiplyAdd(VectorLoadByte4(srcRow + (c.first + k) * 4), VectorSetFloat1(c.weights[k]), acc);
+			VectorStore(acc, tmpRow + x * 4);
+		}
+	});
+
+	// vertical pass, rounded and clamped back to bytes
+	const VectorRegister half = VectorSetFloat1(0.5f);
+	const VectorRegister maxValue = VectorSetFloat1(255.0f);
+	ParallelFor(dstHeight, [&](int32 y)
+	{
+		const auto &r = rows[y];
+		uint8 *dstRow = dst + int64(y) * dstWidth * 4;
+		for (int32 x = 0; x < dstWidth; ++x)
+		{
+			VectorRegister acc = half;
+			for (int32 k = 0; k < r.weights.Num(); ++k)
+				acc = VectorMultiplyAdd(VectorLoad(tmp.GetData() + (int64(r.first + k) * dstWidth + x) * 4), VectorSetFloat1(r.weights[k]), acc);
+			acc = VectorMin(VectorMax(acc, VectorZero()), maxValue);
+			VectorStoreByte4(acc, dstRow + x * 4);
+		}
+	});
+}
+
+bool ItSeez3D::PreprocessPhoto(const uint8 *data, int64 size, TArray<uint8> &result)
+{
+	SCOPE_CYCLE_COUNTER(STAT_AvatarSdk_PhotoPreprocess);
+
+	const int32 maxDimension = MaxPhotoDimension();
+	const auto format = DetectFormat(data, size);
+	if (maxDimension <= 0 || format == EImageFormat::Invalid)
+		return false;
+
+	const double startTime = FPlatformTime::Seconds();
+
+	auto &imageWrapperModule = FModuleManager::GetModuleChecked<IImageWrapperModule>(FName("ImageWrapper"));
+	IImageWrapperPtr decoder = imageWrapperModule.CreateImageWrapper(format);
+	if (!decoder.IsValid() || !decoder->SetCompressed(data, size))
+	{
+		UE_LOG(LogAvatarSdk, Warning, TEXT("Unable to decode photo, uploading it as is"));
+		return false;
+	}
+
+	// the header is enough to tell a small photo, it is uploaded as is without decoding the pixels
+	int32 w = decoder->GetWidth(), h = decoder->GetHeight();
+	const float scale = FMath::Min(1.0f, float(maxDimension) / FMath::Max(w, h));
+	if (scale >= 1.0f)
+		return false;
+
+	const TArray<uint8> *bgra = nullptr;
+	if (!decoder->GetRaw(ERGBFormat::BGRA, 8, bgra))
+	{
+		UE_LOG(LogAvatarSdk, Warning, TEXT("Unable to decode photo, uploading it as is"));
+		return false;
+	}
+
+	// the re-encoded JPEG has no EXIF, so the orientation goes into the pixels
+	const int32 orientation = format == EImageFormat::JPEG ? JpegOrientation(data, size) : 1;
+	TArray<uint8> oriented;
+	if (orientation != 1)
+		OrientBGRA(*bgra, w, h, orientation, oriented);
+	const TArray<uint8> &source = orientation != 1 ? oriented : *bgra;
+
+	const int32 dstW = FMath::Max(1, FMath::RoundToInt(w * scale)), dstH = FMath::Max(1, FMath::RoundToInt(h * scale));
+	TArray<uint8> pixels;
+	pixels.SetNumUninitialized(dstW * dstH * 4);
+	ResizeBGRA(source.GetData(), w, h, pixels.GetData(), dstW, dstH);
+
+	IImageWrapperPtr encoder = imageWrapperModule.CreateImageWrapper(EImageFormat::JPEG);
+	if (!encoder.IsValid() || !encoder->SetRaw(pixels.GetData(), pixels.Num(), dstW, dstH, ERGBFormat::BGRA, 8))
+		return false;
+	result = encoder->GetCompressed(JpegQuality());
+
+	const double seconds = FPlatformTime::Seconds() - startTime;
+	if (result.Num() == 0 || result.Num() >= size)
+	{
+		UE_LOG(LogAvatarSdk, Log, TEXT("Re-encoded photo is not smaller (%d vs %lld bytes), uploading original"), result.Num(), size);
+		result.Empty();
+		return false;
+	}
+
+	INC_DWORD_STAT_BY(STAT_AvatarSdk_PhotoKBSaved, uint32((size - result.Num()) / 1024));
+	UE_LOG(LogAvatarSdk, Log, TEXT("Photo %dx%d -> %dx%d, %lld -> %d bytes (%lld saved) in %.1f ms"),
+		w, h, dstW, dstH, size, result.Num(), size - result.Num(), seconds * 1000.0);
+	return true;
+}
+
+void ItSeez3D::PreprocessPhotoAsync(FHttpResponsePtr photoResponse, const FOnPhotoReady &onReady,
+	const TMap<FString, FString> *keyParameters)
+{
+	if (!IsPhotoPreprocessingEnabled() && !keyParameters)
+	{
+		const auto &bytes = photoResponse->GetContent();
+		onReady(bytes.GetData(), bytes.Num(), FString());
+		return;
+	}
+
+	TSharedRef<PreprocessJob, ESPMode::ThreadSafe> job = MakeShareable(new PreprocessJob());
+	job->response = photoResponse;
+	if (keyParameters)
+	{
+		job->keyParameters = *keyParameters;
+		job->bNeedsKey = true;
+	}
+	RunPreprocessJob(job, onReady);
+}
+
+void ItSeez3D::PreprocessPhotoAsync(const FString &photoPath, const FOnPhotoReady &onReady,
+	const TMap<FString, FString> *keyParameters)
+{
+	TSharedRef<PreprocessJob, ESPMode::ThreadSafe> job = MakeShareable(new PreprocessJob());
+	job->path = photoPath;
+	if (keyParameters)
+	{
+		job->keyParameters = *keyParameters;
+		job->bNeedsKey = true;
+	}
+	RunPreprocessJob(job, onReady);
+}
@@ -0,0 +1,45 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "Runtime/Online/HTTP/Public/Http.h"
+
+
+namespace ItSeez3D
+{
+	/// Receives the photo bytes to upload on the game thread, the data is valid only during the call.
+	/// photoKey is the PhotoIndex key of the bytes, empty if no key parameters were given.
+	typedef TFunction<void(const uint8 *data, int64 size, const FString &photoKey)> FOnPhotoReady;
+
+	/// Photos larger than PhotoMaxDimension (game config) are downscaled and re-encoded
+	/// to JPEG with PhotoJpegQuality. Zero max dimension disables preprocessing.
+	bool IsPhotoPreprocessingEnabled();
+
+	/// Resizes BGRA8 image with a box filter, vectorized over the four channels.
+	void ResizeBGRA(const uint8 *src, int32 srcWidth, int32 srcHeight, uint8 *dst, int32 dstWidth, int32 dstHeight);
+
+	/// Returns false if the photo is already small enough or can't be decoded, upload the original then.
+	/// The EXIF orientation of a JPEG is applied to the pixels, the result is always upright.
+	bool PreprocessPhoto(const uint8 *data, int64 size, TArray<uint8> &result);
+
+	/// Runs PreprocessPhoto on a worker thread for the downloaded photo or the photo file. With keyParameters
+	/// the photo key is hashed on the worker as well, the downloaded photo then goes to the worker even with
+	/// preprocessing disabled.
+	void PreprocessPhotoAsync(FHttpResponsePtr photoResponse, const FOnPhotoReady &onReady,
+		const TMap<FString, FString> *keyParameters = nullptr);
+
+	/// The file is read whole on the worker even with preprocessing disabled.
+	/// onReady gets an empty photo if the file can't be read.
+	void PreprocessPhotoAsync(const FString &photoPath, const FOnPhotoReady &onReady,
+		const TMap<FString, FString> *keyParameters = nullptr);
+}
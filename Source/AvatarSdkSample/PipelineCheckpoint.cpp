@@ -0,0 +1,148 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#include "PipelineCheckpoint.h"
+
+#include "Paths.h"
+#include "Misc/FileHelper.h"
+
+#include "Runtime/Json/Public/Json.h"
+
+#include "AsyncFileIO.h"
+#include "AvatarSdkSample.h"
+
+
+namespace
+{
+	FString CheckpointPath()
+	{
+		return FPaths::Combine(ItSeez3D::DownloadLocation(), TEXT("pipeline.json"));
+	}
+}
+
+ItSeez3D::PipelineCheckpoint & ItSeez3D::PipelineCheckpoint::Get()
+{
+	static PipelineCheckpoint checkpoint;
+	return checkpoint;
+}
+
+ItSeez3D::PipelineCheckpoint::PipelineCheckpoint()
+{
+	Load();
+}
+
+void ItSeez3D::PipelineCheckpoint::SaveAvatar(const AvatarData &newAvatar)
+{
+	if (!avatar.IsValid() || avatar->code != newAvatar.code)
+	{
+		haircut.Reset();
+		bFinished = false;
+	}
+	avatar = MakeShareable(new AvatarData(newAvatar));
+	Save();
+}
+
+void ItSeez3D::PipelineCheckpoint::SaveHaircut(const HaircutData &newHaircut)
+{
+	haircut = MakeShareable(new HaircutData(newHaircut));
+	Save();
+}
+
+void ItSeez3D::PipelineCheckpoint::MarkFinished()
+{
+	if (bFinished)
+		return;
+
+	bFinished = true;
+	Save();
+}
+
+void ItSeez3D::PipelineCheckpoint::Clear()
+{
+	avatar.Reset();
+	haircut.Reset();
+	bFinished = false;
+	Save();
+}
+
+TSharedPtr<ItSeez3D::AvatarData> ItSeez3D::PipelineCheckpoint::PendingAvatar() const
+{
+	if (!avatar.IsValid() || bFinished)
+		return nullptr;
+	return MakeShareable(new AvatarData(*avatar));
+}
+
+TSharedPtr<ItSeez3D::HaircutData> ItSeez3D::PipelineCheckpoint::ChosenHaircut(const FString &avatarCode) const
+{
+	if (!avatar.IsValid() || !haircut.IsValid() || avatar->code != avatarCode)
+		return nullptr;
+	return MakeShareable(new HaircutData(*haircut));
+}
+
+void ItSeez3D::PipelineCheckpoint::Load()
+{
+	FString text;
+	if (!FFileHelper::LoadFileToString(text, *CheckpointPath(), FILEREAD_Silent))
+		return;
+
+	TSharedPtr<FJsonObject> json;
+	auto reader = TJsonReaderFactory<>::Create(text);
+	if (!FJsonSerializer::Deserialize(reader, json) || !json.IsValid())
+	{
+		UE_LOG(LogAvatarSdk, Warning, TEXT("Pipeline checkpoint is damaged, ignoring it"));
+		return;
+	}
+
+	// same field names as the server json, so the api structs read them
+	const TSharedPtr<FJsonObject> *avatarJson = nullptr, *haircutJson = nullptr;
+	if (!json->TryGetObjectField("avatar", avatarJson))
+		return;
+	avatar = MakeShareable(new AvatarData(**avatarJson));
+	if (json->TryGetObjectField("haircut", haircutJson))
+		haircut = MakeShareable(new HaircutData(**haircutJson));
+	json->TryGetBoolField("finished", bFinished);
+
+	UE_LOG(LogAvatarSdk, Log, TEXT("Last avatar %s, status %s, haircut %s, %s"), *avatar->code, *avatar->status,
+		haircut.IsValid() ? *haircut->id : TEXT("not chosen"), bFinished ? TEXT("finished") : TEXT("unfinished"));
+}
+
+void ItSeez3D::PipelineCheckpoint::Save() const
+{
+	TSharedRef<FJsonObject> json = MakeShareable(new FJsonObject());
+	if (avatar.IsValid())
+	{
+		TSharedRef<FJsonObject> avatarJson = MakeShareable(new FJsonObject());
+		avatarJson->SetStringField("code", avatar->code);
+		avatarJson->SetStringField("status", avatar->status);
+		avatarJson->SetStringField("mesh", avatar->mesh);
+		avatarJson->SetStringField("texture", avatar->texture);
+		avatarJson->SetStringField("haircuts", avatar->haircuts);
+		avatarJson->SetNumberField("progress", avatar->progress);
+		json->SetObjectField("avatar", avatarJson);
+	}
+	if (haircut.IsValid())
+	{
+		TSharedRef<FJsonObject> haircutJson = MakeShareable(new FJsonObject());
+		haircutJson->SetStringField("identity", haircut->id);
+		haircutJson->SetStringField("mesh", haircut->mesh);
+		haircutJson->SetStringField("texture", haircut->texture);
+		haircutJson->SetStringField("pointcloud", haircut->pointCloud);
+		json->SetObjectField("haircut", haircutJson);
+	}
+	json->SetBoolField("finished", bFinished);
+
+	FString text;
+	auto writer = TJsonWriterFactory<>::Create(&text);
+	FJsonSerializer::Serialize(json, writer);
+
+	const FTCHARToUTF8 utf8(*text);
+	TArray<uint8> bytes((const uint8 *)utf8.Get(), utf8.Length());
+	SaveFileAsync(CheckpointPath(), MoveTemp(bytes));
+}
@@ -0,0 +1,51 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "AvatarApi.h"
+
+
+namespace ItSeez3D
+{
+	/// Progress of the last avatar generation, saved to DownloadLocation()/pipeline.json at every stage, so an app
+	/// killed while the server computes the avatar resumes polling after restart instead of uploading the photo again.
+	/// Finished downloads are not recorded, the asset cache already knows them.
+	class PipelineCheckpoint
+	{
+	public:
+		static PipelineCheckpoint & Get();
+
+		/// Call after the upload and when the computation completes, the avatar urls are stored as received.
+		void SaveAvatar(const AvatarData &avatar);
+		void SaveHaircut(const HaircutData &haircut);
+		void MarkFinished();
+		void Clear();
+
+		/// Uploaded avatar not displayed yet, null if there is none.
+		TSharedPtr<AvatarData> PendingAvatar() const;
+
+		/// Haircut chosen for the avatar, null if none was chosen.
+		TSharedPtr<HaircutData> ChosenHaircut(const FString &avatarCode) const;
+
+	private:
+		PipelineCheckpoint();
+
+		void Load();
+		void Save() const;
+
+	private:
+		TSharedPtr<AvatarData> avatar;
+		TSharedPtr<HaircutData> haircut;
+		bool bFinished = false;
+	};
+}
@@ -11,14 +11,31 @@
 #include "Ply.h"
 
 #include <string>
+#include <streambuf>
 #include <cassert>
 
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
 
-DEFINE_LOG_CATEGORY_STATIC(LogPly, All, All)
+#include "AvatarSdkSample.h"
 
 
 namespace
 {
+	// bump when the cooked layout or the conversion changes, older cooked meshes are then cooked again
+	const int32 cookedMeshVersion = 1;
+
+	// read-only stream over a buffer, avoids copying the file contents into a string stream
+	class MemoryStreamBuf : public std::streambuf
+	{
+	public:
+		MemoryStreamBuf(const uint8 *data, int32 size)
+		{
+			char *begin = (char *)data;
+			setg(begin, begin, begin + size);
+		}
+	};
+
 	void parsePlyHeader(
 		std::istream &inputMesh,
 		bool &existVertices,
@@ -98,22 +115,22 @@ void ItSeez3D::LoadModelFromBinPLY(
 
 	if (loadVertices && !existVertices)
 	{
-		UE_LOG(LogPly, Error, TEXT("Error: vertices don't exist in mesh file."));
+		UE_LOG(LogAvatarSdk, Error, TEXT("Error: vertices don't exist in mesh file."));
 		loadVertices = false;
 	}
 	if (loadVerticesNormals && !existVerticesNormals)
 	{
-		UE_LOG(LogPly, Error, TEXT("Error: normals don't exist in mesh file."));
+		UE_LOG(LogAvatarSdk, Error, TEXT("Error: normals don't exist in mesh file."));
 		loadVerticesNormals = false;
 	}
 	if (loadFaces && !existFaces)
 	{
-		UE_LOG(LogPly, Error, TEXT("Error: faces don't exist in mesh file."));
+		UE_LOG(LogAvatarSdk, Error, TEXT("Error: faces don't exist in mesh file."));
 		loadFaces = false;
 	}
 	if (loadUvMapping && !existUvMapping)
 	{
-		UE_LOG(LogPly, Error, TEXT("Error: uv mapping does not exist in mesh file."));
+		UE_LOG(LogAvatarSdk, Error, TEXT("Error: uv mapping does not exist in mesh file."));
 		loadUvMapping = false;
 	}
 
@@ -175,6 +192,19 @@ void ItSeez3D::LoadModelFromBinPLY(
 	}
 }
 
+void ItSeez3D::LoadModelFromBinPLY(
+	const TArray<uint8> &inputMesh,
+	TArray<FVector> *vertices,
+	TArray<FVector> *verticesNormals,
+	TArray<int32> *faces,
+	TArray<TArray<FVector2D>> *uvMapping
+)
+{
+	MemoryStreamBuf buffer(inputMesh.GetData(), inputMesh.Num());
+	std::istream stream(&buffer);
+	LoadModelFromBinPLY(stream, vertices, verticesNormals, faces, uvMapping);
+}
+
 void ItSeez3D::FlipNormals(TArray<int32> &faces, TArray<TArray<FVector2D>> &faceUv)
 {
 	assert(faces.Num() % 3 == 0);
@@ -248,7 +278,7 @@ void ItSeez3D::ConvertToUnrealFormat(
 	for (int i = 0; i < numVertices; ++i)
 		uv[i] = vertexUv[i];
 
-	UE_LOG(LogPly, Log, TEXT("Before transformation: %d vertices, after: %d vertices"), originalVertices.Num(), vertices.Num());
+	UE_LOG(LogAvatarSdk, Log, TEXT("Before transformation: %d vertices, after: %d vertices"), originalVertices.Num(), vertices.Num());
 }
 
 void ItSeez3D::AdjustPhysicalUnits(TArray<FVector> &vertices, float scale)
@@ -256,3 +286,44 @@ void ItSeez3D::AdjustPhysicalUnits(TArray<FVector> &vertices, float scale)
 	for (auto &p : vertices)
 		p *= scale;
 }
+
+bool ItSeez3D::CookMesh(const TArray<uint8> &plyBytes, CookedMesh &mesh)
+{
+	TArray<FVector> originalVertices;
+	TArray<TArray<FVector2D>> faceUv;
+	LoadModelFromBinPLY(plyBytes, &originalVertices, nullptr, &mesh.faces, &faceUv);
+	if (originalVertices.Num() == 0 || mesh.faces.Num() == 0)
+		return false;
+	FlipNormals(mesh.faces, faceUv);
+
+	TArray<int> indexMap;
+	ConvertToUnrealFormat(originalVertices, faceUv, mesh.faces, mesh.vertices, mesh.uv, indexMap);
+	AdjustPhysicalUnits(mesh.vertices);
+	return true;
+}
+
+TArray<uint8> ItSeez3D::SaveCookedMesh(const CookedMesh &mesh)
+{
+	TArray<uint8> bytes;
+	FMemoryWriter writer(bytes);
+	int32 version = cookedMeshVersion;
+	writer << version;
+	writer << const_cast<TArray<FVector> &>(mesh.vertices);
+	writer << const_cast<TArray<int32> &>(mesh.faces);
+	writer << const_cast<TArray<FVector2D> &>(mesh.uv);
+	return bytes;
+}
+
+bool ItSeez3D::LoadCookedMesh(const TArray<uint8> &bytes, CookedMesh &mesh)
+{
+	FMemoryReader reader(bytes);
+	int32 version = 0;
+	reader << version;
+	if (version != cookedMeshVersion)
+		return false;
+
+	reader << mesh.vertices;
+	reader << mesh.faces;
+	reader << mesh.uv;
+	return !reader.IsError() && mesh.vertices.Num() == mesh.uv.Num();
+}
@@ -25,6 +25,15 @@ namespace ItSeez3D
 		TArray<TArray<FVector2D>> *uvMapping = nullptr
 	);
 
+	/// Parses the model straight from the file contents in memory.
+	void LoadModelFromBinPLY(
+		const TArray<uint8> &inputMesh,
+		TArray<FVector> *vertices = nullptr,
+		TArray<FVector> *verticesNormals = nullptr,
+		TArray<int32> *faces = nullptr,
+		TArray<TArray<FVector2D>> *uvMapping = nullptr
+	);
+
 	void FlipNormals(
 		TArray<int32> &faces,
 		TArray<TArray<FVector2D>> &faceUv
@@ -43,4 +52,19 @@ namespace ItSeez3D
 		TArray<FVector> &vertices,
 		float scale = 100
 	);
+
+	/// Mesh ready for CreateMeshSection: flipped faces, one uv per vertex, Unreal units.
+	struct CookedMesh
+	{
+		TArray<FVector> vertices;
+		TArray<int32> faces;
+		TArray<FVector2D> uv;
+	};
+
+	/// Parses and converts the binary PLY, safe to call on worker threads.
+	bool CookMesh(const TArray<uint8> &plyBytes, CookedMesh &mesh);
+
+	/// Cooked meshes are cached next to the PLY, so loading them again skips the parsing and conversion.
+	TArray<uint8> SaveCookedMesh(const CookedMesh &mesh);
+	bool LoadCookedMesh(const TArray<uint8> &bytes, CookedMesh &mesh);
 }
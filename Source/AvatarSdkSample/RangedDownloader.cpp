@@ -0,0 +1,341 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#include "RangedDownloader.h"
+
+#include "Paths.h"
+#include "Containers/Ticker.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/ConfigCacheIni.h"
+
+#include "AsyncFileIO.h"
+#include "AuthSession.h"
+#include "AvatarSdkSample.h"
+#include "AvatarSdkStats.h"
+#include "HttpCache.h"
+#include "HttpCompression.h"
+
+
+DEFINE_STAT(STAT_AvatarSdk_DownloadKBResumed);
+DEFINE_STAT(STAT_AvatarSdk_DownloadKBRefetched);
+
+
+namespace
+{
+	const int32 maxConsecutiveFailures = 6;
+	const float firstRetryDelay = 0.5f;
+	const float maxRetryDelay = 15.0f;
+
+	int32 foregroundDownloads = 0;
+
+	// simulates dropped connections to measure how much data has to be downloaded again
+	TAutoConsoleVariable<float> CVarDownloadDropRate(
+		TEXT("AvatarSdk.DownloadDropRate"),
+		0.0f,
+		TEXT("Fraction of received download chunks discarded as if the connection dropped, 0 disables"));
+
+	// "bytes 0-1023/4096" -> first byte and total size
+	bool ParseContentRange(const FString &header, int64 &first, int64 &total)
+	{
+		FString range, size;
+		if (!header.Split(TEXT("/"), &range, &size))
+			return false;
+
+		FString unit, bytes, last;
+		if (!range.Split(TEXT(" "), &unit, &bytes) || !bytes.Split(TEXT("-"), &range, &last))
+			return false;
+
+		first = FCString::Atoi64(*range);
+		total = size.IsNumeric() ? FCString::Atoi64(*size) : -1;
+		return total > 0;
+	}
+}
+
+void ItSeez3D::RangedDownloader::Download(const FString &url, const FString &partPath,
+	const FOnAssetDownloaded &onCompleted, const FRangeRequestDispatcher &dispatcher)
+{
+	TSharedRef<RangedDownloader> downloader = MakeShareable(new RangedDownloader(url, partPath, onCompleted, dispatcher));
+	downloader->Start();
+}
+
+int32 ItSeez3D::RangedDownloader::NumForegroundDownloads()
+{
+	return foregroundDownloads;
+}
+
+ItSeez3D::RangedDownloader::RangedDownloader(const FString &url, const FString &partPath,
+	const FOnAssetDownloaded &onCompleted, const FRangeRequestDispatcher &dispatcher)
+	: url(url)
+	, partPath(partPath)
+	, onCompleted(onCompleted)
+	, dispatcher(dispatcher)
+	, bForeground(!dispatcher)
+{
+	int32 chunkSizeKB = 1024;
+	parallelRanges = 1;
+	if (GConfig)
+	{
+		GConfig->GetInt(configSection, TEXT("DownloadChunkSizeKB"), chunkSizeKB, GGameIni);
+		GConfig->GetInt(configSection, TEXT("DownloadParallelRanges"), parallelRanges, GGameIni);
+	}
+	chunkSize = int64(FMath::Max(16, chunkSizeKB)) * 1024;
+	parallelRanges = FMath::Max(1, parallelRanges);
+}
+
+void ItSeez3D::RangedDownloader::Start()
+{
+	startTime = FPlatformTime::Seconds();
+	if (bForeground)
+		++foregroundDownloads;
+
+	TSharedRef<RangedDownloader> self = AsShared();
+	LoadFileAsync(partPath, [self](const FFileBytes &part)
+	{
+		self->OnPartLoaded(part);
+	});
+}
+
+void ItSeez3D::RangedDownloader::OnPartLoaded(const FFileBytes &part)
+{
+	if (part.IsValid() && part->Num() > 0)
+	{
+		content = MoveTemp(*part);
+		resumedBytes = content.Num();
+		INC_DWORD_STAT_BY(STAT_AvatarSdk_DownloadKBResumed, uint32(resumedBytes / 1024));
+		UE_LOG(LogAvatarSdk, Log, TEXT("Resuming %s from %lld bytes"), *url, resumedBytes);
+	}
+
+	nextOffset = content.Num();
+	Pump();
+}
+
+void ItSeez3D::RangedDownloader::Pump()
+{
+	if (bFinished)
+		return;
+
+	if (totalSize >= 0 && content.Num() == totalSize)
+	{
+		if (contentEncoding.IsEmpty())
+		{
+			INC_DWORD_STAT_BY(STAT_AvatarSdk_HttpDecodedKB, uint32(content.Num() / 1024));
+			const FFileBytes body = ShareBytes(MoveTemp(content));
+			HttpCache::Get().Store(url, eTag, lastModified, body);
+			Finish(true, body);
+			return;
+		}
+
+		// ranges of a compressed asset are slices of one compressed stream
+		TArray<uint8> decoded;
+		if (!DecodeBody(contentEncoding, content, decoded))
+		{
+			UE_LOG(LogAvatarSdk, Error, TEXT("Unable to decode %s download of %s"), *contentEncoding, *url);
+			DeleteFileAsync(partPath);
+			Finish(false, FFileBytes());
+			return;
+		}
+		INC_DWORD_STAT_BY(STAT_AvatarSdk_HttpDecodedKB, uint32(decoded.Num() / 1024));
+		UE_LOG(LogAvatarSdk, Log, TEXT("%s: %d bytes over the wire, %d decoded (%s)"), *url, content.Num(), decoded.Num(), *contentEncoding);
+		const FFileBytes body = ShareBytes(MoveTemp(decoded));
+		HttpCache::Get().Store(url, eTag, lastModified, body);
+		Finish(true, body);
+		return;
+	}
+
+	// the first range tells the size, the rest may go in parallel
+	const int32 maxInFlight = totalSize < 0 ? 1 : parallelRanges;
+	while (rangesInFlight < maxInFlight)
+	{
+		int64 offset;
+		if (retryOffsets.Num() > 0)
+			offset = retryOffsets.Pop(false);
+		else if ((totalSize >= 0 && nextOffset < totalSize) || (totalSize < 0 && rangesInFlight == 0 && retriesScheduled == 0 && nextOffset == content.Num()))
+		{
+			offset = nextOffset;
+			nextOffset += chunkSize;
+		}
+		else
+			break;
+
+		RequestRange(offset);
+	}
+}
+
+void ItSeez3D::RangedDownloader::RequestRange(int64 offset)
+{
+	int64 last = offset + chunkSize - 1;
+	if (totalSize >= 0)
+		last = FMath::Min(last, totalSize - 1);
+
+	auto request = GetRequest(url, AuthSession::Get().GetCredentials());
+	request->SetHeader(TEXT("Range"), FString::Printf(TEXT("bytes=%lld-%lld"), offset, last));
+
+	++rangesInFlight;
+	TSharedRef<RangedDownloader> self = AsShared();
+	SendAuthorized(request, [self, offset](FHttpResponsePtr response, bool bWasSuccessful)
+	{
+		self->OnRangeReceived(offset, response, bWasSuccessful);
+	}, dispatcher);
+}
+
+void ItSeez3D::RangedDownloader::OnRangeReceived(int64 offset, FHttpResponsePtr response, bool bWasSuccessful)
+{
+	--rangesInFlight;
+	if (bFinished)
+		return;
+
+	const int32 code = response.IsValid() ? response->GetResponseCode() : 0;
+	if (!bWasSuccessful || !response.IsValid())
+	{
+		OnRangeFailed(offset, response);
+		return;
+	}
+
+	if (code == EHttpResponseCodes::NotModified)
+	{
+		// asset is stored in the http cache and did not change
+		TSharedRef<RangedDownloader> self = AsShared();
+		HttpCache::Get().Resolve(response, [self, offset, response](FHttpResponsePtr cached)
+		{
+			if (self->bFinished)
+				return;
+			if (cached.IsValid() && cached->GetResponseCode() == EHttpResponseCodes::Ok)
+				self->Finish(true, CopyBytes(cached->GetContent()));
+			else
+				self->OnRangeFailed(offset, response);
+		});
+		return;
+	}
+
+	if (code == EHttpResponseCodes::Ok)
+	{
+		// server ignores ranges and sent the whole asset
+		refetchedBytes += content.Num();
+		INC_DWORD_STAT_BY(STAT_AvatarSdk_DownloadKBRefetched, uint32(content.Num() / 1024));
+		TSharedRef<RangedDownloader> self = AsShared();
+		HttpCache::Get().Resolve(response, [self](FHttpResponsePtr stored)
+		{
+			self->Finish(true, CopyBytes(stored->GetContent()));
+		});
+		return;
+	}
+
+	if (code == 416 && content.Num() > 0)
+	{
+		UE_LOG(LogAvatarSdk, Warning, TEXT("Partial download of %s does not match the asset, starting over"), *url);
+		Restart();
+		return;
+	}
+
+	int64 first = -1, total = -1;
+	if (code != 206 || !ParseContentRange(response->GetHeader(TEXT("Content-Range")), first, total) || first != offset
+		|| (totalSize >= 0 && total != totalSize))
+	{
+		OnRangeFailed(offset, response);
+		return;
+	}
+
+	const auto &chunk = response->GetContent();
+	const float dropRate = CVarDownloadDropRate.GetValueOnGameThread();
+	if (dropRate > 0 && FMath::FRand() < dropRate)
+	{
+		UE_LOG(LogAvatarSdk, Log, TEXT("Dropping range at %lld of %s (AvatarSdk.DownloadDropRate)"), offset, *url);
+		OnRangeFailed(offset, response);
+		return;
+	}
+
+	totalSize = total;
+	consecutiveFailures = 0;
+	eTag = response->GetHeader(TEXT("ETag"));
+	lastModified = response->GetHeader(TEXT("Last-Modified"));
+	contentEncoding = response->GetHeader(TEXT("Content-Encoding")).Trim().TrimTrailing();
+	if (contentEncoding.Equals(TEXT("identity"), ESearchCase::IgnoreCase))
+		contentEncoding.Empty();
+	INC_DWORD_STAT_BY(STAT_AvatarSdk_HttpWireKB, uint32(chunk.Num() / 1024));
+	if (offset == content.Num())
+	{
+		Append(chunk);
+		while (auto *next = receivedChunks.Find(content.Num()))
+		{
+			const int64 key = content.Num();
+			Append(*next);
+			receivedChunks.Remove(key);
+		}
+	}
+	else
+		receivedChunks.Add(offset, chunk);
+
+	Pump();
+}
+
+void ItSeez3D::RangedDownloader::OnRangeFailed(int64 offset, FHttpResponsePtr response)
+{
+	// whatever arrived of this range is lost, it is requested again from its start
+	const int64 lostBytes = response.IsValid() ? response->GetContent().Num() : 0;
+	refetchedBytes += lostBytes;
+	INC_DWORD_STAT_BY(STAT_AvatarSdk_DownloadKBRefetched, uint32(lostBytes / 1024));
+
+	if (++consecutiveFailures > maxConsecutiveFailures)
+	{
+		UE_LOG(LogAvatarSdk, Error, TEXT("Download of %s failed at %lld of %lld bytes, it will resume from the .part file next time"),
+			*url, int64(content.Num()), totalSize);
+		Finish(false, FFileBytes());
+		return;
+	}
+
+	const float delay = FMath::Min(maxRetryDelay, firstRetryDelay * FMath::Pow(2.0f, float(consecutiveFailures - 1)));
+	UE_LOG(LogAvatarSdk, Warning, TEXT("Range at %lld of %s failed, retrying in %.1f s"), offset, *url, delay);
+
+	++retriesScheduled;
+	TSharedRef<RangedDownloader> self = AsShared();
+	FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateLambda([self, offset](float)
+	{
+		--self->retriesScheduled;
+		self->retryOffsets.Add(offset);
+		self->Pump();
+		return false;
+	}), delay);
+}
+
+void ItSeez3D::RangedDownloader::Append(const TArray<uint8> &chunk)
+{
+	content.Append(chunk);
+	AppendFileAsync(partPath, TArray<uint8>(chunk));
+}
+
+void ItSeez3D::RangedDownloader::Restart()
+{
+	refetchedBytes += content.Num();
+	INC_DWORD_STAT_BY(STAT_AvatarSdk_DownloadKBRefetched, uint32(content.Num() / 1024));
+
+	DeleteFileAsync(partPath);
+
+	content.Reset();
+	receivedChunks.Empty();
+	retryOffsets.Empty();
+	totalSize = -1;
+	nextOffset = 0;
+	Pump();
+}
+
+void ItSeez3D::RangedDownloader::Finish(bool bSucceeded, const FFileBytes &data)
+{
+	bFinished = true;
+	if (bForeground)
+		--foregroundDownloads;
+	if (bSucceeded)
+	{
+		DeleteFileAsync(partPath);
+		UE_LOG(LogAvatarSdk, Log, TEXT("Downloaded %s: %d bytes in %.2f s, %lld resumed, %lld re-fetched"),
+			*url, data->Num(), FPlatformTime::Seconds() - startTime, resumedBytes, refetchedBytes);
+	}
+
+	onCompleted.ExecuteIfBound(bSucceeded, data);
+}
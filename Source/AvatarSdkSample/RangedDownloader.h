@@ -0,0 +1,93 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "AvatarApi.h"
+#include "AsyncFileIO.h"
+#include "AuthSession.h"
+
+
+namespace ItSeez3D
+{
+	/// Called on the game thread with the whole asset, null if the download failed. Keep the buffer to avoid copying it.
+	DECLARE_DELEGATE_TwoParams(FOnAssetDownloaded, bool /*bSucceeded*/, const FFileBytes & /*content*/);
+
+	typedef FResponseHandler FRangeResponseHandler;
+	typedef FRequestDispatcher FRangeRequestDispatcher;
+
+	/// Downloads an asset with Range requests of DownloadChunkSizeKB (game config). Every received chunk is appended
+	/// to the .part file, so a dropped connection costs at most the chunks in flight, and an interrupted download
+	/// continues from the .part file after a restart. Up to DownloadParallelRanges chunks are requested at once.
+	/// The .part file is read and appended through the async file queue, never on the game thread.
+	/// Assets are addressed by immutable urls, so the .part file is not revalidated against the server.
+	/// Ranges are sent with the current session credentials, a rejected token is replaced and the range sent again.
+	/// Complete assets with validators go to HttpCache, later downloads of the same url are conditional.
+	/// Ranges of a compressed asset are stored as they come and the whole asset is decoded at the end.
+	class RangedDownloader : public TSharedFromThis<RangedDownloader>
+	{
+	public:
+		/// The downloader keeps itself alive until onCompleted fires. The .part file is removed after a successful download.
+		static void Download(const FString &url, const FString &partPath,
+			const FOnAssetDownloaded &onCompleted, const FRangeRequestDispatcher &dispatcher = FRangeRequestDispatcher());
+
+		/// Downloads started without a dispatcher are the ones the user waits for, background work yields to them.
+		static int32 NumForegroundDownloads();
+
+	private:
+		RangedDownloader(const FString &url, const FString &partPath,
+			const FOnAssetDownloaded &onCompleted, const FRangeRequestDispatcher &dispatcher);
+
+		void Start();
+		void OnPartLoaded(const FFileBytes &part);
+		void Pump();
+		void RequestRange(int64 offset);
+		void OnRangeReceived(int64 offset, FHttpResponsePtr response, bool bWasSuccessful);
+		void OnRangeFailed(int64 offset, FHttpResponsePtr response);
+		void Append(const TArray<uint8> &chunk);
+		void Restart();
+		void Finish(bool bSucceeded, const FFileBytes &data);
+
+	private:
+		FString url;
+		FString partPath;
+		FOnAssetDownloaded onCompleted;
+		FRangeRequestDispatcher dispatcher;
+
+		int64 chunkSize;
+		int32 parallelRanges;
+
+		// contiguous downloaded prefix, mirrored to the .part file through the async file queue
+		TArray<uint8> content;
+
+		// chunks received ahead of the prefix when ranges run in parallel
+		TMap<int64, TArray<uint8>> receivedChunks;
+		TArray<int64> retryOffsets;
+
+		// validators of the asset, it is stored in the http cache when complete
+		FString eTag, lastModified;
+
+		// compressed assets are decoded when all ranges arrived
+		FString contentEncoding;
+
+		int64 totalSize = -1;
+		int64 nextOffset = 0;
+		int32 rangesInFlight = 0;
+		int32 retriesScheduled = 0;
+		int32 consecutiveFailures = 0;
+		bool bFinished = false;
+		bool bForeground = false;
+
+		int64 resumedBytes = 0, refetchedBytes = 0;
+		double startTime = 0;
+	};
+}
@@ -0,0 +1,64 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#include "SingleFlight.h"
+
+#include "AvatarSdkSample.h"
+#include "AvatarSdkStats.h"
+
+
+DEFINE_STAT(STAT_AvatarSdk_DownloadsDeduplicated);
+
+
+ItSeez3D::SingleFlight & ItSeez3D::SingleFlight::Get()
+{
+	static SingleFlight registry;
+	return registry;
+}
+
+bool ItSeez3D::SingleFlight::Join(const FString &key, const FOnFlightCompleted &onCompleted, const TFunction<void(const FFlightDone &)> &start)
+{
+	if (auto *waiters = flights.Find(key))
+	{
+		waiters->Add(onCompleted);
+		INC_DWORD_STAT(STAT_AvatarSdk_DownloadsDeduplicated);
+		UE_LOG(LogAvatarSdk, Log, TEXT("Attached to %s in flight, %d waiting"), *key, waiters->Num());
+		return false;
+	}
+
+	flights.Add(key).Add(onCompleted);
+	const FString flightKey = key;
+	start([flightKey](bool bSucceeded)
+	{
+		SingleFlight::Get().Complete(flightKey, bSucceeded);
+	});
+	return true;
+}
+
+bool ItSeez3D::SingleFlight::IsInFlight(const FString &key) const
+{
+	return flights.Contains(key);
+}
+
+int32 ItSeez3D::SingleFlight::NumWaiters(const FString &key) const
+{
+	const auto *waiters = flights.Find(key);
+	return waiters ? waiters->Num() : 0;
+}
+
+void ItSeez3D::SingleFlight::Complete(const FString &key, bool bSucceeded)
+{
+	TArray<FOnFlightCompleted> waiters;
+	if (!flights.RemoveAndCopyValue(key, waiters))
+		return;
+
+	for (const auto &waiter : waiters)
+		waiter.ExecuteIfBound(bSucceeded);
+}
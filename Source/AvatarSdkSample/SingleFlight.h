@@ -0,0 +1,44 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+
+namespace ItSeez3D
+{
+	DECLARE_DELEGATE_OneParam(FOnFlightCompleted, bool /*bSucceeded*/);
+
+	/// Called by the work of a flight once its result is in place.
+	typedef TFunction<void(bool bSucceeded)> FFlightDone;
+
+	/// Process-wide registry of in-flight work keyed by asset id, e.g. a download together with its unzip.
+	/// The first requester of a key starts the work, the ones that come while it runs only wait for the result.
+	class SingleFlight
+	{
+	public:
+		static SingleFlight & Get();
+
+		/// Returns true if this call started the work.
+		bool Join(const FString &key, const FOnFlightCompleted &onCompleted, const TFunction<void(const FFlightDone &)> &start);
+
+		bool IsInFlight(const FString &key) const;
+
+		/// Number of requesters waiting for the flight, zero if there is none.
+		int32 NumWaiters(const FString &key) const;
+
+	private:
+		void Complete(const FString &key, bool bSucceeded);
+
+	private:
+		TMap<FString, TArray<FOnFlightCompleted>> flights;
+	};
+}
@@ -0,0 +1,149 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#include "StatusPolling.h"
+
+#include "AvatarSdkSample.h"
+#include "AvatarSdkStats.h"
+
+
+DEFINE_STAT(STAT_AvatarSdk_StatusPolls);
+DEFINE_STAT(STAT_AvatarSdk_DetectionDelayAvg);
+DEFINE_STAT(STAT_AvatarSdk_DetectionDelayP95);
+
+
+namespace
+{
+	// polling interval limits, seconds
+	const float minDelay = 0.5f;
+	const float maxDelay = 10.0f;
+	const float unknownProgressDelay = 2.0f;
+	const float maxErrorDelay = 30.0f;
+	const int maxConsecutiveErrors = 8;
+
+	// fraction of the predicted remaining time to wait before the next poll
+	const float remainingTimeFraction = 0.5f;
+
+	// number of latest responses used to estimate the progress rate
+	const int maxSamples = 5;
+}
+
+void ItSeez3D::StatusPollSchedule::Reset()
+{
+	samples.Empty();
+	predictedFinish = -1;
+	lastIncompleteTime = -1;
+	consecutiveErrors = 0;
+}
+
+void ItSeez3D::StatusPollSchedule::OnStatus(double now, int progress, bool bCompleted)
+{
+	consecutiveErrors = 0;
+	StatusPollMetrics::Get().AddPoll();
+
+	if (bCompleted)
+	{
+		if (lastIncompleteTime >= 0)
+			StatusPollMetrics::Get().AddDetectionDelay(now - lastIncompleteTime);
+		predictedFinish = now;
+		return;
+	}
+
+	lastIncompleteTime = now;
+	samples.Add({ now, progress });
+	if (samples.Num() > maxSamples)
+		samples.RemoveAt(0);
+
+	// progress may stay still while the avatar waits in the server queue, no estimate until it moves
+	const auto &first = samples[0], &last = samples.Last();
+	const double dt = last.time - first.time;
+	const int dp = last.progress - first.progress;
+	if (dp > 0 && dt > 0)
+	{
+		const double rate = dp / dt;
+		predictedFinish = now + FMath::Max(0, 100 - progress) / rate;
+		UE_LOG(LogAvatarSdk, Verbose, TEXT("Progress %d, %.2f %%/s, finish predicted in %.1f s"), progress, rate, predictedFinish - now);
+	}
+}
+
+void ItSeez3D::StatusPollSchedule::OnError()
+{
+	++consecutiveErrors;
+}
+
+bool ItSeez3D::StatusPollSchedule::ShouldRetry() const
+{
+	return consecutiveErrors <= maxConsecutiveErrors;
+}
+
+float ItSeez3D::StatusPollSchedule::NextDelay(double now) const
+{
+	if (consecutiveErrors > 0)
+	{
+		const float backoff = FMath::Min(maxErrorDelay, unknownProgressDelay * float(1 << FMath::Min(consecutiveErrors, 8)));
+		return backoff * FMath::FRandRange(0.5f, 1.0f);
+	}
+
+	if (predictedFinish < 0)
+		return unknownProgressDelay;
+
+	const double remaining = predictedFinish - now;
+	if (remaining > 0)
+		return FMath::Clamp(float(remaining * remainingTimeFraction), minDelay, maxDelay);
+
+	// past the predicted finish: keep polling often, but slow down if the prediction was far off
+	return FMath::Min(unknownProgressDelay, minDelay * float(1.0 - remaining / 4.0));
+}
+
+ItSeez3D::StatusPollMetrics & ItSeez3D::StatusPollMetrics::Get()
+{
+	static StatusPollMetrics metrics;
+	return metrics;
+}
+
+void ItSeez3D::StatusPollMetrics::AddPoll()
+{
+	INC_DWORD_STAT(STAT_AvatarSdk_StatusPolls);
+}
+
+void ItSeez3D::StatusPollMetrics::AddDetectionDelay(double seconds)
+{
+	if (delays.Num() < maxDelays)
+		delays.Add(seconds);
+	else
+		delays[nextDelay] = seconds;
+	nextDelay = (nextDelay + 1) % maxDelays;
+
+	SET_FLOAT_STAT(STAT_AvatarSdk_DetectionDelayAvg, AverageDelay());
+	SET_FLOAT_STAT(STAT_AvatarSdk_DetectionDelayP95, Percentile95Delay());
+	UE_LOG(LogAvatarSdk, Log, TEXT("Completion detected %.2f s late, avg %.2f s, p95 %.2f s over the last %d avatars"), seconds, AverageDelay(), Percentile95Delay(), delays.Num());
+}
+
+double ItSeez3D::StatusPollMetrics::AverageDelay() const
+{
+	if (delays.Num() == 0)
+		return 0;
+
+	double sum = 0;
+	for (double d : delays)
+		sum += d;
+	return sum / delays.Num();
+}
+
+double ItSeez3D::StatusPollMetrics::Percentile95Delay() const
+{
+	if (delays.Num() == 0)
+		return 0;
+
+	auto sorted = delays;
+	sorted.Sort();
+	const int idx = FMath::Clamp(FMath::CeilToInt(0.95f * sorted.Num()) - 1, 0, sorted.Num() - 1);
+	return sorted[idx];
+}
@@ -0,0 +1,73 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+
+namespace ItSeez3D
+{
+	/// Decides when to ask the server for the avatar status next.
+	/// Completion time is extrapolated from the progress reported by previous responses,
+	/// polls get denser as the predicted finish approaches. Errors back off exponentially with jitter.
+	class StatusPollSchedule
+	{
+	public:
+		void Reset();
+
+		/// Feed every successfully parsed status response.
+		void OnStatus(double now, int progress, bool bCompleted);
+		void OnError();
+
+		/// Seconds until the next status request should be sent.
+		float NextDelay(double now) const;
+
+		/// False once too many requests in a row have failed.
+		bool ShouldRetry() const;
+
+		/// Estimated time when progress reaches 100, negative if unknown.
+		double PredictedFinish() const { return predictedFinish; }
+
+	private:
+		struct Sample
+		{
+			double time;
+			int progress;
+		};
+
+		TArray<Sample> samples;
+		double predictedFinish = -1;
+		double lastIncompleteTime = -1;
+		int consecutiveErrors = 0;
+	};
+
+	/// Aggregates how late avatar completion was noticed (time between the last "not completed"
+	/// response and the "completed" one) and publishes average and 95th percentile to STATGROUP_AvatarSdk.
+	/// Only the last maxDelays avatars are kept, so a long session neither grows nor slows the metrics.
+	class StatusPollMetrics
+	{
+	public:
+		static StatusPollMetrics & Get();
+
+		void AddPoll();
+		void AddDetectionDelay(double seconds);
+
+		double AverageDelay() const;
+		double Percentile95Delay() const;
+
+	private:
+		static const int32 maxDelays = 256;
+
+		// ring buffer, the oldest delay is overwritten once it is full
+		TArray<double> delays;
+		int32 nextDelay = 0;
+	};
+}
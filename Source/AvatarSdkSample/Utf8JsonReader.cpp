@@ -0,0 +1,455 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#include "Utf8JsonReader.h"
+
+#include "HAL/IConsoleManager.h"
+#include "Misc/ScopeExit.h"
+
+#include "Runtime/Json/Public/Json.h"
+
+#include "AvatarApi.h"
+#include "AvatarSdkSample.h"
+
+
+namespace
+{
+	// deeper documents are rejected, so malformed input can't exhaust the stack
+	const int32 maxNestingDepth = 64;
+
+	bool IsNumberChar(char c)
+	{
+		return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+	}
+
+	int32 HexValue(char c)
+	{
+		if (c >= '0' && c <= '9')
+			return c - '0';
+		if (c >= 'a' && c <= 'f')
+			return c - 'a' + 10;
+		if (c >= 'A' && c <= 'F')
+			return c - 'A' + 10;
+		return -1;
+	}
+
+	bool ReadHex4(const char *p, uint32 &value)
+	{
+		value = 0;
+		for (int32 i = 0; i < 4; ++i)
+		{
+			const int32 digit = HexValue(p[i]);
+			if (digit < 0)
+				return false;
+			value = (value << 4) | uint32(digit);
+		}
+		return true;
+	}
+
+	void AppendUtf8(TArray<ANSICHAR> &out, uint32 codepoint)
+	{
+		if (codepoint < 0x80)
+			out.Add(ANSICHAR(codepoint));
+		else if (codepoint < 0x800)
+		{
+			out.Add(ANSICHAR(0xC0 | (codepoint >> 6)));
+			out.Add(ANSICHAR(0x80 | (codepoint & 0x3F)));
+		}
+		else if (codepoint < 0x10000)
+		{
+			out.Add(ANSICHAR(0xE0 | (codepoint >> 12)));
+			out.Add(ANSICHAR(0x80 | ((codepoint >> 6) & 0x3F)));
+			out.Add(ANSICHAR(0x80 | (codepoint & 0x3F)));
+		}
+		else
+		{
+			out.Add(ANSICHAR(0xF0 | (codepoint >> 18)));
+			out.Add(ANSICHAR(0x80 | ((codepoint >> 12) & 0x3F)));
+			out.Add(ANSICHAR(0x80 | ((codepoint >> 6) & 0x3F)));
+			out.Add(ANSICHAR(0x80 | (codepoint & 0x3F)));
+		}
+	}
+
+	// unescapes the string body into utf-8 bytes, returns false on malformed escape sequences
+	bool Unescape(const char *begin, const char *end, TArray<ANSICHAR> &out)
+	{
+		out.Reset();
+		for (const char *p = begin; p < end; ++p)
+		{
+			if (*p != '\\')
+			{
+				out.Add(*p);
+				continue;
+			}
+
+			if (++p >= end)
+				return false;
+			switch (*p)
+			{
+			case '"': out.Add('"'); break;
+			case '\\': out.Add('\\'); break;
+			case '/': out.Add('/'); break;
+			case 'b': out.Add('\b'); break;
+			case 'f': out.Add('\f'); break;
+			case 'n': out.Add('\n'); break;
+			case 'r': out.Add('\r'); break;
+			case 't': out.Add('\t'); break;
+			case 'u':
+			{
+				uint32 codepoint;
+				if (end - p < 5 || !ReadHex4(p + 1, codepoint))
+					return false;
+				p += 4;
+
+				// surrogate pair
+				uint32 low;
+				if (codepoint >= 0xD800 && codepoint < 0xDC00 && end - p >= 7 && p[1] == '\\' && p[2] == 'u' && ReadHex4(p + 3, low)
+					&& low >= 0xDC00 && low < 0xE000)
+				{
+					codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+					p += 6;
+				}
+				AppendUtf8(out, codepoint);
+				break;
+			}
+			default:
+				return false;
+			}
+		}
+		return true;
+	}
+
+	FString Utf8ToString(const ANSICHAR *data, int32 length)
+	{
+		const FUTF8ToTCHAR converted(data, length);
+		return FString(converted.Length(), converted.Get());
+	}
+}
+
+ItSeez3D::Utf8JsonReader::Utf8JsonReader(const uint8 *data, int64 size)
+	: pos((const char *)data)
+	, end((const char *)data + size)
+{
+}
+
+bool ItSeez3D::Utf8JsonReader::ReadObject(TFunctionRef<void(Utf8JsonReader &reader)> onField)
+{
+	if (depth == maxNestingDepth)
+		return Fail();
+	if (!Expect('{'))
+		return false;
+
+	++depth;
+	ON_SCOPE_EXIT { --depth; };
+
+	SkipWhitespace();
+	if (pos < end && *pos == '}')
+	{
+		++pos;
+		return true;
+	}
+
+	for (;;)
+	{
+		SkipWhitespace();
+		const char *begin, *finish;
+		bool bEscaped;
+		if (!ScanString(begin, finish, bEscaped) || !Expect(':'))
+			return Fail();
+
+		SkipWhitespace();
+		keyBegin = begin;
+		keyEnd = finish;
+		const char *valueStart = pos;
+		onField(*this);
+		if (bError)
+			return false;
+		if (pos == valueStart && !SkipValue())
+			return false;
+
+		SkipWhitespace();
+		if (pos < end && *pos == ',')
+		{
+			++pos;
+			continue;
+		}
+		return Expect('}');
+	}
+}
+
+bool ItSeez3D::Utf8JsonReader::ReadArray(TFunctionRef<void(Utf8JsonReader &reader)> onElement)
+{
+	if (depth == maxNestingDepth)
+		return Fail();
+	if (!Expect('['))
+		return false;
+
+	++depth;
+	ON_SCOPE_EXIT { --depth; };
+
+	SkipWhitespace();
+	if (pos < end && *pos == ']')
+	{
+		++pos;
+		return true;
+	}
+
+	for (;;)
+	{
+		SkipWhitespace();
+		const char *valueStart = pos;
+		onElement(*this);
+		if (bError)
+			return false;
+		if (pos == valueStart && !SkipValue())
+			return false;
+
+		SkipWhitespace();
+		if (pos < end && *pos == ',')
+		{
+			++pos;
+			continue;
+		}
+		return Expect(']');
+	}
+}
+
+bool ItSeez3D::Utf8JsonReader::KeyIs(const char *key) const
+{
+	const int64 length = FCStringAnsi::Strlen(key);
+	return keyEnd - keyBegin == length && FMemory::Memcmp(keyBegin, key, length) == 0;
+}
+
+FString ItSeez3D::Utf8JsonReader::Key() const
+{
+	return Utf8ToString(keyBegin, int32(keyEnd - keyBegin));
+}
+
+bool ItSeez3D::Utf8JsonReader::ReadString(FString &value)
+{
+	SkipWhitespace();
+	if (pos < end && *pos == 'n')
+	{
+		SkipLiteral("null");
+		return false;
+	}
+	if (pos >= end || *pos != '"')
+		return false;
+
+	const char *begin, *finish;
+	bool bEscaped;
+	if (!ScanString(begin, finish, bEscaped))
+		return Fail();
+
+	if (!bEscaped)
+	{
+		value = Utf8ToString(begin, int32(finish - begin));
+		return true;
+	}
+
+	if (!Unescape(begin, finish, scratch))
+		return Fail();
+	value = Utf8ToString(scratch.GetData(), scratch.Num());
+	return true;
+}
+
+bool ItSeez3D::Utf8JsonReader::ReadNumber(double &value)
+{
+	SkipWhitespace();
+	if (pos < end && *pos == 'n')
+	{
+		SkipLiteral("null");
+		return false;
+	}
+
+	const char *begin = pos;
+	while (pos < end && IsNumberChar(*pos))
+		++pos;
+
+	const int64 length = pos - begin;
+	if (length == 0)
+		return false;
+
+	ANSICHAR buffer[64];
+	if (length >= int64(ARRAY_COUNT(buffer)))
+		return Fail();
+	FMemory::Memcpy(buffer, begin, length);
+	buffer[length] = 0;
+	value = FCStringAnsi::Atod(buffer);
+	return true;
+}
+
+bool ItSeez3D::Utf8JsonReader::ReadInt(int32 &value)
+{
+	double number;
+	if (!ReadNumber(number))
+		return false;
+	value = int32(number);
+	return true;
+}
+
+bool ItSeez3D::Utf8JsonReader::SkipValue()
+{
+	SkipWhitespace();
+	if (pos >= end)
+		return Fail();
+
+	switch (*pos)
+	{
+	case '{':
+		return ReadObject([](Utf8JsonReader &) {});
+	case '[':
+		return ReadArray([](Utf8JsonReader &) {});
+	case '"':
+	{
+		const char *begin, *finish;
+		bool bEscaped;
+		return ScanString(begin, finish, bEscaped) || Fail();
+	}
+	case 't':
+		return SkipLiteral("true");
+	case 'f':
+		return SkipLiteral("false");
+	case 'n':
+		return SkipLiteral("null");
+	default:
+	{
+		double number;
+		return ReadNumber(number) || Fail();
+	}
+	}
+}
+
+void ItSeez3D::Utf8JsonReader::SkipWhitespace()
+{
+	while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r'))
+		++pos;
+}
+
+bool ItSeez3D::Utf8JsonReader::Expect(char c)
+{
+	SkipWhitespace();
+	if (pos < end && *pos == c)
+	{
+		++pos;
+		return true;
+	}
+	return Fail();
+}
+
+bool ItSeez3D::Utf8JsonReader::ScanString(const char *&begin, const char *&finish, bool &bEscaped)
+{
+	if (pos >= end || *pos != '"')
+		return false;
+
+	bEscaped = false;
+	const char *p = pos + 1;
+	begin = p;
+	while (p < end && *p != '"')
+	{
+		if (*p == '\\')
+		{
+			bEscaped = true;
+			++p;
+		}
+		++p;
+	}
+	if (p >= end)
+		return false;
+
+	finish = p;
+	pos = p + 1;
+	return true;
+}
+
+bool ItSeez3D::Utf8JsonReader::SkipLiteral(const char *literal)
+{
+	const int64 length = FCStringAnsi::Strlen(literal);
+	if (end - pos >= length && FMemory::Memcmp(pos, literal, length) == 0)
+	{
+		pos += length;
+		return true;
+	}
+	return Fail();
+}
+
+bool ItSeez3D::Utf8JsonReader::Fail()
+{
+	bError = true;
+	return false;
+}
+
+namespace
+{
+	// synthetic response shaped like the haircuts list of an avatar
+	TArray<uint8> MakeHaircutsJson(int32 count)
+	{
+		FString json = TEXT("[");
+		for (int32 i = 0; i < count; ++i)
+		{
+			const FString url = FString::Printf(TEXT("https://api.avatarsdk.com/avatars/00000000-0000-0000-0000-000000000000/haircuts/haircut_%d"), i);
+			json += FString::Printf(TEXT("%s{\"identity\": \"haircut_%d\", \"url\": \"%s/\", \"mesh\": \"%s/mesh/\", \"texture\": \"%s/texture/\", ")
+				TEXT("\"pointcloud\": \"%s/pointcloud/\", \"preview\": \"%s/preview/\", \"gender\": \"unisex\", \"tags\": [\"short\", \"dark\"], \"size\": %d}"),
+				i > 0 ? TEXT(", ") : TEXT(""), i, *url, *url, *url, *url, *url, 1000 + i);
+		}
+		json += TEXT("]");
+
+		const FTCHARToUTF8 utf8(*json);
+		TArray<uint8> bytes;
+		bytes.Append((const uint8 *)utf8.Get(), utf8.Length());
+		return bytes;
+	}
+
+	void BenchmarkJsonCommand(const TArray<FString> &args)
+	{
+		const int32 haircutCount = args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*args[0])) : 100;
+		const int32 iterations = args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*args[1])) : 50;
+		const auto content = MakeHaircutsJson(haircutCount);
+
+		// previous path: content converted to FString, full DOM, then fields copied out
+		int32 domCount = 0;
+		double startTime = FPlatformTime::Seconds();
+		for (int32 i = 0; i < iterations; ++i)
+		{
+			const FUTF8ToTCHAR converted((const ANSICHAR *)content.GetData(), content.Num());
+			TSharedPtr<FJsonValue> root;
+			auto jsonReader = TJsonReaderFactory<>::Create(FString(converted.Length(), converted.Get()));
+			if (!FJsonSerializer::Deserialize(jsonReader, root) || !root.IsValid())
+				break;
+
+			TArray<TSharedPtr<ItSeez3D::HaircutData>> haircuts;
+			for (const auto &haircutJson : root->AsArray())
+				haircuts.Emplace(new ItSeez3D::HaircutData(*haircutJson->AsObject()));
+			domCount = haircuts.Num();
+		}
+		const double domSeconds = (FPlatformTime::Seconds() - startTime) / iterations;
+
+		int32 streamCount = 0;
+		startTime = FPlatformTime::Seconds();
+		for (int32 i = 0; i < iterations; ++i)
+		{
+			TArray<TSharedPtr<ItSeez3D::HaircutData>> haircuts;
+			if (!ItSeez3D::ReadHaircuts(content, haircuts))
+				break;
+			streamCount = haircuts.Num();
+		}
+		const double streamSeconds = (FPlatformTime::Seconds() - startTime) / iterations;
+
+		UE_LOG(LogAvatarSdk, Log, TEXT("Haircuts list of %d entries (%d bytes): DOM %.3f ms (%d parsed), streaming %.3f ms (%d parsed), %.1fx"),
+			haircutCount, content.Num(), domSeconds * 1000.0, domCount, streamSeconds * 1000.0, streamCount,
+			streamSeconds > 0 ? domSeconds / streamSeconds : 0.0);
+	}
+
+	FAutoConsoleCommand benchmarkJsonCommand(
+		TEXT("AvatarSdk.BenchmarkJson"),
+		TEXT("Compares DOM and streaming decoding of a synthetic haircuts list. Usage: AvatarSdk.BenchmarkJson [haircutCount] [iterations]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&BenchmarkJsonCommand)
+	);
+}
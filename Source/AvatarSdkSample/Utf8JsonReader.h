@@ -0,0 +1,64 @@
+/* Copyright (C) Itseez3D, Inc. - All Rights Reserved
+* You may not use this file except in compliance with an authorized license
+* Unauthorized copying of this file, via any medium is strictly prohibited
+* Proprietary and confidential
+* UNLESS REQUIRED BY APPLICABLE LAW OR AGREED BY ITSEEZ3D, INC. IN WRITING, SOFTWARE DISTRIBUTED UNDER THE LICENSE IS DISTRIBUTED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED
+* See the License for the specific language governing permissions and limitations under the License.
+* Written by Itseez3D, Inc. <support@itseez3D.com>, April 2017
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+
+namespace ItSeez3D
+{
+	/// Forward-only reader over UTF-8 JSON bytes, e.g. HTTP response content.
+	/// Values are pulled by the caller while walking objects and arrays, no DOM is built
+	/// and only the strings actually read are converted to FString.
+	class Utf8JsonReader
+	{
+	public:
+		/// The data is not copied, it must stay valid while the reader is used.
+		Utf8JsonReader(const uint8 *data, int64 size);
+
+		/// Calls onField for every member of the object. The callback may read the value with one of the
+		/// Read* methods, values it doesn't read are skipped. Keys are compared as raw bytes, see KeyIs.
+		/// Objects and arrays nested more than 64 levels deep fail the read.
+		bool ReadObject(TFunctionRef<void(Utf8JsonReader &reader)> onField);
+
+		/// Calls onElement for every element of the array, unread elements are skipped.
+		bool ReadArray(TFunctionRef<void(Utf8JsonReader &reader)> onElement);
+
+		/// Key of the member currently visited by ReadObject.
+		bool KeyIs(const char *key) const;
+		FString Key() const;
+
+		/// Return false and leave the value untouched for null or a value of a different type.
+		bool ReadString(FString &value);
+		bool ReadNumber(double &value);
+		bool ReadInt(int32 &value);
+
+		bool SkipValue();
+
+		bool HasError() const { return bError; }
+
+	private:
+		void SkipWhitespace();
+		bool Expect(char c);
+		bool ScanString(const char *&begin, const char *&end, bool &bEscaped);
+		bool SkipLiteral(const char *literal);
+		bool Fail();
+
+	private:
+		const char *pos, *end;
+		const char *keyBegin = nullptr, *keyEnd = nullptr;
+		int32 depth = 0;
+		bool bError = false;
+
+		// decoded bytes of strings with escape sequences
+		TArray<ANSICHAR> scratch;
+	};
+}
@@ -21,9 +21,9 @@
 #include "Paths.h"
 
 #include "minizip/unzip.h"
+#include "minizip/ioapi_mem.h"
 
-
-DEFINE_LOG_CATEGORY_STATIC(LogZipUtils, All, All)
+#include "AvatarSdkSample.h"
 
 
 namespace
@@ -33,13 +33,13 @@ namespace
 		unz_global_info globalInfo = { 0 };
 		if (unzGetGlobalInfo(hFile, &globalInfo) != UNZ_OK)
 		{
-			UE_LOG(LogZipUtils, Error, TEXT("unzGetGlobalInfo error"));
+			UE_LOG(LogAvatarSdk, Error, TEXT("unzGetGlobalInfo error"));
 			return false;
 		}
 
 		if (unzGoToFirstFile(hFile) != UNZ_OK)
 		{
-			UE_LOG(LogZipUtils, Error, TEXT("unzGoToFirstFile error"));
+			UE_LOG(LogAvatarSdk, Error, TEXT("unzGoToFirstFile error"));
 			return false;
 		}
 
@@ -53,7 +53,7 @@ namespace
 		{
 			if (unzOpenCurrentFile(hFile) != UNZ_OK)
 			{
-				UE_LOG(LogZipUtils, Error, TEXT("unzOpenCurrentFile error"));
+				UE_LOG(LogAvatarSdk, Error, TEXT("unzOpenCurrentFile error"));
 				return false;
 			}
 
@@ -61,13 +61,13 @@ namespace
 			
 			if (unzGetCurrentFileInfo(hFile, &fileInfo, filename, maxNameLength, 0, 0, 0, 0) != UNZ_OK)
 			{
-				UE_LOG(LogZipUtils, Error, TEXT("unzGetCurrentFileInfo error"));
+				UE_LOG(LogAvatarSdk, Error, TEXT("unzGetCurrentFileInfo error"));
 				unzCloseCurrentFile(hFile);
 				return false;
 			}
 
 			const auto absoluteFilename = FPaths::Combine(directory, FString(UTF8_TO_TCHAR(filename)));
-			UE_LOG(LogZipUtils, Log, TEXT("Unzipping file %s..."), *absoluteFilename);
+			UE_LOG(LogAvatarSdk, Log, TEXT("Unzipping file %s..."), *absoluteFilename);
 
 			const std::string absoluteFilenameStr{ TCHAR_TO_UTF8(*absoluteFilename) };
 			
@@ -79,13 +79,53 @@ namespace
 				totalSize += readSize;
 			}
 
-			UE_LOG(LogZipUtils, Log, TEXT("Total file size %d"), totalSize);
+			UE_LOG(LogAvatarSdk, Log, TEXT("Total file size %d"), totalSize);
 
 			unzCloseCurrentFile(hFile);
 		} while (unzGoToNextFile(hFile) == UNZ_OK);
 
 		return true;
 	}
+
+	bool ReadEntries(unzFile hFile, TFunctionRef<bool(const FString &, TArray<uint8> &)> onEntry)
+	{
+		if (unzGoToFirstFile(hFile) != UNZ_OK)
+		{
+			UE_LOG(LogAvatarSdk, Error, TEXT("unzGoToFirstFile error"));
+			return false;
+		}
+
+		constexpr int maxNameLength = 1 << 10;
+		char filename[maxNameLength];
+		TArray<uint8> content;
+
+		do
+		{
+			unz_file_info fileInfo;
+			if (unzGetCurrentFileInfo(hFile, &fileInfo, filename, maxNameLength, 0, 0, 0, 0) != UNZ_OK || unzOpenCurrentFile(hFile) != UNZ_OK)
+			{
+				UE_LOG(LogAvatarSdk, Error, TEXT("Unable to open archive entry"));
+				return false;
+			}
+
+			content.SetNumUninitialized(int32(fileInfo.uncompressed_size), false);
+			const int readSize = unzReadCurrentFile(hFile, content.GetData(), uint32(content.Num()));
+			unzCloseCurrentFile(hFile);
+
+			const FString name = UTF8_TO_TCHAR(filename);
+			if (readSize != content.Num())
+			{
+				UE_LOG(LogAvatarSdk, Error, TEXT("Unable to read %s, %d of %d bytes"), *name, readSize, content.Num());
+				return false;
+			}
+
+			UE_LOG(LogAvatarSdk, Log, TEXT("Unzipped %s, %d bytes"), *name, content.Num());
+			if (!onEntry(name, content))
+				return false;
+		} while (unzGoToNextFile(hFile) == UNZ_OK);
+
+		return true;
+	}
 }
 
 
@@ -93,18 +133,66 @@ bool ItSeez3D::UnzipFile(const FString &path)
 {
 	const auto directory = FPaths::GetPath(path);
 
-	UE_LOG(LogZipUtils, Log, TEXT("Unzipping %s to directory %s..."), *path, *directory);
+	UE_LOG(LogAvatarSdk, Log, TEXT("Unzipping %s to directory %s..."), *path, *directory);
 	const std::string zipFilename{ TCHAR_TO_UTF8(*path) };
 
 	unzFile hFile = unzOpen(zipFilename.c_str());
 	if (!hFile)
 	{
-		UE_LOG(LogZipUtils, Error, TEXT("Unable to open file %s"), *path);
+		UE_LOG(LogAvatarSdk, Error, TEXT("Unable to open file %s"), *path);
 		return false;
 	}
 
 	const bool success = DoUnzip(hFile, directory);
 	unzClose(hFile);
-	UE_LOG(LogZipUtils, Log, TEXT("Unzipping finished, success: %d"), success);
+	UE_LOG(LogAvatarSdk, Log, TEXT("Unzipping finished, success: %d"), success);
+	return success;
+}
+
+bool ItSeez3D::UnzipBuffer(const uint8 *data, int64 size, const FString &directory)
+{
+	UE_LOG(LogAvatarSdk, Log, TEXT("Unzipping %lld bytes from memory to directory %s..."), size, *directory);
+
+	// memory ioapi only reads from the buffer when the archive is opened without the create flag
+	ourmemory_t memory = { 0 };
+	memory.base = (char *)data;
+	memory.size = uint32(size);
+	memory.grow = 0;
+
+	zlib_filefunc_def fileFunc;
+	fill_memory_filefunc(&fileFunc, &memory);
+
+	unzFile hFile = unzOpen2("__memory__", &fileFunc);
+	if (!hFile)
+	{
+		UE_LOG(LogAvatarSdk, Error, TEXT("Unable to open archive from memory"));
+		return false;
+	}
+
+	const bool success = DoUnzip(hFile, directory);
+	unzClose(hFile);
+	UE_LOG(LogAvatarSdk, Log, TEXT("Unzipping finished, success: %d"), success);
+	return success;
+}
+
+bool ItSeez3D::UnzipBufferEntries(const uint8 *data, int64 size, TFunctionRef<bool(const FString &, TArray<uint8> &)> onEntry)
+{
+	ourmemory_t memory = { 0 };
+	memory.base = (char *)data;
+	memory.size = uint32(size);
+	memory.grow = 0;
+
+	zlib_filefunc_def fileFunc;
+	fill_memory_filefunc(&fileFunc, &memory);
+
+	unzFile hFile = unzOpen2("__memory__", &fileFunc);
+	if (!hFile)
+	{
+		UE_LOG(LogAvatarSdk, Error, TEXT("Unable to open archive from memory"));
+		return false;
+	}
+
+	const bool success = ReadEntries(hFile, onEntry);
+	unzClose(hFile);
 	return success;
 }
@@ -16,4 +16,11 @@
 namespace ItSeez3D
 {
 	bool UnzipFile(const FString &path);
+
+	/// Extracts archive held in memory (e.g. HTTP response content) into the directory, without a temporary zip file.
+	bool UnzipBuffer(const uint8 *data, int64 size, const FString &directory);
+
+	/// Extracts every entry of the archive held in memory into a buffer and passes it to the callback, nothing is written to disk.
+	/// The callback may move the buffer away.
+	bool UnzipBufferEntries(const uint8 *data, int64 size, TFunctionRef<bool(const FString & /*name*/, TArray<uint8> & /*content*/)> onEntry);
 }